@@ -0,0 +1,304 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "blake3.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define X86_TARGET_ATTRIBUTE(s) __attribute__((target(s)))
+#else
+#define X86_TARGET_ATTRIBUTE(s)
+#endif
+
+namespace cpu_check {
+namespace {
+
+using ChunksFn = Blake3::ChunksFn;
+constexpr int kLanes = Blake3::kLanes;
+constexpr size_t kBlockSize = Blake3::kBlockSize;
+constexpr size_t kChunkSize = Blake3::kChunkSize;
+constexpr size_t kBlocksPerChunk = kChunkSize / kBlockSize;
+
+enum Flags : uint32_t {
+  kChunkStart = 1,
+  kChunkEnd = 2,
+  kParent = 4,
+  kRoot = 8,
+};
+
+constexpr uint32_t kIv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                             0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// Message word order of each round.
+constexpr int kSchedule[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+typedef uint32_t Scalar __attribute__((vector_size(4)));
+typedef uint32_t Lanes4 __attribute__((vector_size(16)));
+typedef uint32_t Lanes8 __attribute__((vector_size(32)));
+typedef uint32_t Lanes16 __attribute__((vector_size(64)));
+
+inline uint32_t LoadLittleEndian(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// The vector helpers below are always inlined, so their vector arguments and
+// results never cross a call boundary whose ABI could differ.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+template <typename V>
+__attribute__((always_inline)) inline V Rotr(const V& x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+template <typename V>
+__attribute__((always_inline)) inline void G(V* v, int a, int b, int c, int d,
+                                             const V& x, const V& y) {
+  v[a] += v[b] + x;
+  v[d] = Rotr(v[d] ^ v[a], 16);
+  v[c] += v[d];
+  v[b] = Rotr(v[b] ^ v[c], 12);
+  v[a] += v[b] + y;
+  v[d] = Rotr(v[d] ^ v[a], 8);
+  v[c] += v[d];
+  v[b] = Rotr(v[b] ^ v[c], 7);
+}
+
+// Compresses block 'm' into chaining value 'cv', in each lane of 'V'. Inlined
+// into callers compiled for the instruction set 'V' suits.
+template <typename V>
+__attribute__((always_inline)) inline void Compress(V* cv, const V* m,
+                                                    const V& counter_lo,
+                                                    const V& counter_hi,
+                                                    uint32_t block_len,
+                                                    uint32_t flags) {
+  V v[16];
+  for (int i = 0; i < 8; i++) v[i] = cv[i];
+  for (int i = 0; i < 4; i++) v[8 + i] = V{} + kIv[i];
+  v[12] = counter_lo;
+  v[13] = counter_hi;
+  v[14] = V{} + block_len;
+  v[15] = V{} + flags;
+  for (int r = 0; r < 7; r++) {
+    const int* s = kSchedule[r];
+    G(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+    G(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+    G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+    G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+    G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+    G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+    G(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+    G(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+  }
+  for (int i = 0; i < 8; i++) cv[i] = v[i] ^ v[i + 8];
+}
+
+// Hashes whole chunks, as many at a time as 'V' holds.
+template <typename V>
+__attribute__((always_inline)) inline void ChunksLanes(const char* p,
+                                                       uint64_t counter,
+                                                       uint32_t (*cvs)[8]) {
+  constexpr int kWidth = sizeof(V) / sizeof(uint32_t);
+  for (int lane0 = 0; lane0 < kLanes; lane0 += kWidth) {
+    const char* chunks = p + lane0 * kChunkSize;
+    V cv[8];
+    for (int i = 0; i < 8; i++) cv[i] = V{} + kIv[i];
+    V counter_lo, counter_hi;
+    for (int l = 0; l < kWidth; l++) {
+      counter_lo[l] = static_cast<uint32_t>(counter + lane0 + l);
+      counter_hi[l] = static_cast<uint32_t>((counter + lane0 + l) >> 32);
+    }
+    for (size_t b = 0; b < kBlocksPerChunk; b++) {
+      const char* block = chunks + b * kBlockSize;
+      V m[16];
+      for (int i = 0; i < 16; i++) {
+        for (int l = 0; l < kWidth; l++) {
+          m[i][l] = LoadLittleEndian(block + l * kChunkSize + 4 * i);
+        }
+      }
+      const uint32_t flags = (b == 0 ? kChunkStart : 0) |
+                             (b == kBlocksPerChunk - 1 ? kChunkEnd : 0);
+      Compress(cv, m, counter_lo, counter_hi, kBlockSize, flags);
+    }
+    for (int l = 0; l < kWidth; l++) {
+      for (int i = 0; i < 8; i++) cvs[lane0 + l][i] = cv[i][l];
+    }
+  }
+}
+
+void ScalarChunks(const char* p, uint64_t counter, uint32_t (*cvs)[8]) {
+  ChunksLanes<Scalar>(p, counter, cvs);
+}
+
+X86_TARGET_ATTRIBUTE("sse2")
+void Sse2Chunks(const char* p, uint64_t counter, uint32_t (*cvs)[8]) {
+  ChunksLanes<Lanes4>(p, counter, cvs);
+}
+
+X86_TARGET_ATTRIBUTE("avx2")
+void Avx2Chunks(const char* p, uint64_t counter, uint32_t (*cvs)[8]) {
+  ChunksLanes<Lanes8>(p, counter, cvs);
+}
+
+X86_TARGET_ATTRIBUTE("avx512f")
+void Avx512Chunks(const char* p, uint64_t counter, uint32_t (*cvs)[8]) {
+  ChunksLanes<Lanes16>(p, counter, cvs);
+}
+
+struct ChunksImpl {
+  ChunksFn chunks;
+  const char* name;
+};
+
+// Returns the widest implementation no wider than 'isa' that this CPU
+// supports.
+const ChunksImpl& Select(SimdIsa isa) {
+  static const ChunksImpl impls[] = {
+      {ScalarChunks, "scalar"},
+      {Sse2Chunks, "sse2"},
+      {Avx2Chunks, "avx2"},
+      {Avx512Chunks, "avx512"},
+  };
+  return impls[static_cast<int>(SupportedSimdIsa(isa))];
+}
+
+// The inputs to a node's final compression, from which come either its
+// chaining value or, at the root, the digest.
+struct Output {
+  Scalar cv[8];
+  Scalar m[16];
+  uint64_t counter;
+  uint32_t block_len;
+  uint32_t flags;
+};
+
+void OutputCv(const Output& o, uint64_t counter, uint32_t flags,
+              uint32_t cv[8]) {
+  Scalar v[8];
+  memcpy(v, o.cv, sizeof(v));
+  Compress(v, o.m, Scalar{static_cast<uint32_t>(counter)},
+           Scalar{static_cast<uint32_t>(counter >> 32)}, o.block_len, flags);
+  for (int i = 0; i < 8; i++) cv[i] = v[i][0];
+}
+
+// Returns the Output of the last block of the 'n' byte chunk at 'p', having
+// compressed the blocks before it.
+Output ChunkOutput(const char* p, size_t n, uint64_t counter) {
+  Output o;
+  for (int i = 0; i < 8; i++) o.cv[i][0] = kIv[i];
+  o.counter = counter;
+  const size_t blocks = std::max<size_t>(1, (n + kBlockSize - 1) / kBlockSize);
+  for (size_t b = 0; b < blocks; b++) {
+    char block[kBlockSize] = {};
+    const size_t len = std::min(kBlockSize, n - b * kBlockSize);
+    memcpy(block, p + b * kBlockSize, len);
+    for (int i = 0; i < 16; i++) o.m[i][0] = LoadLittleEndian(block + 4 * i);
+    o.block_len = len;
+    o.flags = (b == 0 ? kChunkStart : 0) | (b == blocks - 1 ? kChunkEnd : 0);
+    if (b == blocks - 1) break;
+    uint32_t cv[8];
+    OutputCv(o, o.counter, o.flags, cv);
+    for (int i = 0; i < 8; i++) o.cv[i][0] = cv[i];
+  }
+  return o;
+}
+
+Output ParentOutput(const uint32_t left[8], const uint32_t right[8]) {
+  Output o;
+  for (int i = 0; i < 8; i++) {
+    o.cv[i][0] = kIv[i];
+    o.m[i][0] = left[i];
+    o.m[8 + i][0] = right[i];
+  }
+  o.counter = 0;
+  o.block_len = kBlockSize;
+  o.flags = kParent;
+  return o;
+}
+
+}  // namespace
+
+Blake3::Blake3(SimdIsa isa) : chunks_(Select(isa).chunks) {}
+
+void Blake3::PushChunk(const uint32_t cv[8]) {
+  uint32_t merged[8];
+  memcpy(merged, cv, sizeof(merged));
+  // Each trailing zero bit of the new count completes a subtree.
+  for (uint64_t t = ++chunks_done_; (t & 1) == 0; t >>= 1) {
+    const Output o = ParentOutput(stack_[--stack_size_], merged);
+    OutputCv(o, o.counter, o.flags, merged);
+  }
+  memcpy(stack_[stack_size_++], merged, sizeof(merged));
+}
+
+void Blake3::Update(const char* p, size_t n) {
+  auto stripe = [this](const char* s) {
+    uint32_t cvs[kLanes][8];
+    chunks_(s, chunks_done_, cvs);
+    for (int l = 0; l < kLanes; l++) PushChunk(cvs[l]);
+  };
+  while (n) {
+    // A full buffer is followed by more input, so may now be hashed.
+    if (buffered_ == kStripeSize) {
+      stripe(buffer_);
+      buffered_ = 0;
+    }
+    if (buffered_ == 0 && n > kStripeSize) {
+      stripe(p);
+      p += kStripeSize;
+      n -= kStripeSize;
+      continue;
+    }
+    const size_t k = std::min(n, kStripeSize - buffered_);
+    memcpy(buffer_ + buffered_, p, k);
+    buffered_ += k;
+    p += k;
+    n -= k;
+  }
+}
+
+std::string Blake3::Final() {
+  // The chunks of a final, partial, stripe are hashed one at a time.
+  size_t pos = 0;
+  for (; buffered_ - pos > kChunkSize; pos += kChunkSize) {
+    const Output o = ChunkOutput(buffer_ + pos, kChunkSize, chunks_done_);
+    uint32_t cv[8];
+    OutputCv(o, o.counter, o.flags, cv);
+    PushChunk(cv);
+  }
+  Output o = ChunkOutput(buffer_ + pos, buffered_ - pos, chunks_done_);
+  for (int i = stack_size_ - 1; i >= 0; i--) {
+    uint32_t cv[8];
+    OutputCv(o, o.counter, o.flags, cv);
+    o = ParentOutput(stack_[i], cv);
+  }
+  uint32_t root[8];
+  OutputCv(o, 0, o.flags | kRoot, root);
+  return std::string(reinterpret_cast<const char*>(root), sizeof(root));
+}
+
+std::string Blake3::Impl(SimdIsa isa) { return Select(isa).name; }
+
+}  // namespace cpu_check
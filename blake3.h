@@ -0,0 +1,77 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CPU_CHECK_BLAKE3_H_
+#define THIRD_PARTY_CPU_CHECK_BLAKE3_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "simd_isa.h"
+
+namespace cpu_check {
+
+// Streaming BLAKE3 hash, 256 bit result, unkeyed.
+//
+// BLAKE3 hashes 1 KiB chunks independently and merges their chaining values
+// up a binary tree. Here kLanes chunks at a time are hashed in lockstep, 16
+// to an AVX-512 register, 8 to an AVX2 or 4 to an SSE2 one.
+class Blake3 {
+ public:
+  static constexpr size_t kBlockSize = 64;
+  static constexpr size_t kChunkSize = 1024;
+  static constexpr int kLanes = 16;
+  static constexpr size_t kStripeSize = kLanes * kChunkSize;
+
+  // Writes the chaining values of the kLanes chunks at 'p', the first of
+  // which is chunk number 'counter', to 'cvs'.
+  using ChunksFn = void (*)(const char* p, uint64_t counter,
+                            uint32_t (*cvs)[8]);
+
+  // Hashes the chunks in the widest registers of 'isa' that the CPU
+  // supports, or one at a time with scalar code.
+  explicit Blake3(SimdIsa isa);
+
+  Blake3(const Blake3&) = delete;
+  Blake3& operator=(const Blake3&) = delete;
+
+  void Update(const char* p, size_t n);
+
+  // Returns the binary digest of everything passed to Update.
+  std::string Final();
+
+  // Returns name of the implementation used for 'isa': "avx512", "avx2",
+  // "sse2" or "scalar".
+  static std::string Impl(SimdIsa isa = SimdIsa::kAvx512);
+
+ private:
+  // Adds the chaining value of the next chunk, merging completed subtrees.
+  void PushChunk(const uint32_t cv[8]);
+
+  const ChunksFn chunks_;
+  uint64_t chunks_done_ = 0;
+  // Chaining values of the completed subtrees, largest first. One per bit
+  // of chunks_done_, so 54 bits cover any 64 bit input size.
+  uint32_t stack_[54][8];
+  int stack_size_ = 0;
+  // Bytes not yet hashed. Chunks are hashed only once more input follows
+  // them, since the final chunk's output is treated specially.
+  char buffer_[kStripeSize];
+  size_t buffered_ = 0;
+};
+
+}  // namespace cpu_check
+#endif  // THIRD_PARTY_CPU_CHECK_BLAKE3_H_
@@ -12,45 +12,632 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+
 #include "compressor.h"
 
+#include <algorithm>
+#include <limits>
+#include <random>
+
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "log.h"
+#include "utils.h"
 #include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#endif
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 namespace cpu_check {
 
-absl::Status Zlib::Compress(const MalignBuffer &m,
-                            MalignBuffer *compressed) const {
-  uLongf olen = compressBound(m.size());
-  compressed->resize(olen);
-  int err = compress2(reinterpret_cast<Bytef *>(compressed->data()), &olen,
-                      reinterpret_cast<const Bytef *>(m.data()), m.size(),
-                      Z_BEST_SPEED);
-  if (err != Z_OK) {
-    return absl::Status(
-        absl::StatusCode::kInternal,
-        absl::StrFormat("Zlib compression failed: %d srcLen: %d destLen: %d",
-                        err, m.size(), olen));
-  }
-  compressed->resize(olen);
+namespace {
+// Bytes a flush, ending the current block and perhaps adding an empty one,
+// may add beyond what a compressor's one-shot bound allows.
+constexpr size_t kFlushOverhead = 16;
+
+// Returns a random Options::chunk: none, for one-shot compression, or
+// kMinChunk or larger.
+size_t RandomChunk(std::knuth_b *rng) {
+  static constexpr size_t kChunks[] = {0, Compressor::kMinChunk,
+                                       4 * Compressor::kMinChunk,
+                                       16 * Compressor::kMinChunk};
+  return kChunks[std::uniform_int_distribution<int>(0, 3)(*rng)];
+}
+
+// Returns the pieces 'chunk' divides 'n' bytes into, or 1 if 'chunk' is 0.
+size_t Chunks(size_t n, size_t chunk) {
+  return chunk ? std::max<size_t>(1, (n + chunk - 1) / chunk) : 1;
+}
+
+absl::Status Error(const std::string &name, const char *what,
+                   const std::string &detail, size_t in, size_t out) {
+  return absl::Status(absl::StatusCode::kInternal,
+                      absl::StrFormat("%s %s failed: %s in: %d out: %d", name,
+                                      what, detail, in, out));
+}
+
+// Returns the error for a (de)compressor that couldn't be set up, which
+// says nothing of the CPU. See Compressor::Compress.
+absl::Status SetupError(const std::string &name, const char *what,
+                        const std::string &detail) {
+  return absl::Status(
+      absl::StatusCode::kFailedPrecondition,
+      absl::StrFormat("%s %s failed: %s", name, what, detail));
+}
+
+absl::Status ZlibError(const char *what, int err, const z_stream &z) {
+  return Error("Zlib", what,
+               absl::StrFormat("%d (%s)", err, z.msg ? z.msg : ""), z.total_in,
+               z.total_out);
+}
+}  // namespace
+
+std::string Compressor::OptionsJson(const Options &options) const {
+  return absl::StrCat(Json("level", options.level), ", ",
+                      Json("strategy", options.strategy), ", ",
+                      Json("chunk", uint64_t{options.chunk}));
+}
+
+Zlib::Zlib() {}
+
+Zlib::~Zlib() {
+  if (deflate_) deflateEnd(deflate_.get());
+  if (inflate_) inflateEnd(inflate_.get());
+}
+
+Compressor::Options Zlib::RandomOptions(uint64_t seed) const {
+  std::knuth_b rng(seed);
+  Options o;
+  o.level = Z_BEST_SPEED;
+  o.strategy = Z_DEFAULT_STRATEGY;
+  // Half the rounds keep to the cheap default; the rest cover every level
+  // and strategy, and so each of deflate's match finders.
+  if (std::uniform_int_distribution<int>(0, 1)(rng)) {
+    o.level = std::uniform_int_distribution<int>(0, 9)(rng);
+    static constexpr int kStrategies[] = {Z_DEFAULT_STRATEGY, Z_FILTERED,
+                                          Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED};
+    o.strategy = kStrategies[std::uniform_int_distribution<int>(0, 4)(rng)];
+  }
+  o.chunk = RandomChunk(&rng);
+  return o;
+}
+
+size_t Zlib::MaxCompressedSize(size_t n) const {
+  return compressBound(n) + (n / kMinChunk + 1) * kFlushOverhead;
+}
+
+absl::Status Zlib::Compress(const MalignBuffer &m, const Options &options,
+                            MalignBuffer *compressed) {
+  compressed->resize(compressed->capacity());
+  if (!deflate_) {
+    std::unique_ptr<z_stream> z(new z_stream{});
+    const int err = deflateInit2(z.get(), options.level, Z_DEFLATED, MAX_WBITS,
+                                 8, options.strategy);
+    if (err != Z_OK) {
+      return SetupError("Zlib", "deflateInit", std::to_string(err));
+    }
+    deflate_ = std::move(z);
+  }
+  z_stream &z = *deflate_;
+  int err = deflateReset(&z);
+  z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(m.data()));
+  z.avail_in = 0;
+  z.next_out = reinterpret_cast<Bytef *>(compressed->data());
+  z.avail_out = compressed->size();
+  if (err == Z_OK) {
+    // Older zlibs may start the new stream here, hence setting the output
+    // first.
+    err = deflateParams(&z, options.level, options.strategy);
+  }
+  if (err != Z_OK) return ZlibError("deflateReset", err, z);
+
+  const size_t chunk = options.chunk ? options.chunk : m.size();
+  size_t left = m.size();
+  do {
+    const size_t n = std::min(left, chunk);
+    left -= n;
+    z.avail_in = n;
+    err = deflate(&z, left ? Z_SYNC_FLUSH : Z_FINISH);
+    // All input is consumed unless output room ran out.
+    if (z.avail_in != 0) break;
+  } while (left);
+  if (err != Z_STREAM_END) {
+    return ZlibError("compression", err == Z_OK ? Z_BUF_ERROR : err, z);
+  }
+  compressed->resize(z.total_out);
   return absl::OkStatus();
 }
 
 absl::Status Zlib::Decompress(const MalignBuffer &compressed,
-                              MalignBuffer *m) const {
-  uLongf olen = m->size();
-  int err = uncompress(reinterpret_cast<Bytef *>(m->data()), &olen,
-                       reinterpret_cast<const Bytef *>(compressed.data()),
-                       compressed.size());
-  if (err != Z_OK) {
-    return absl::Status(
-        absl::StatusCode::kInternal,
-        absl::StrFormat("Zlib decompression failed: %d srcLen: %d destLen: %d",
-                        err, compressed.size(), olen));
-  }
-  m->resize(olen);
+                              MalignBuffer *m) {
+  if (!inflate_) {
+    std::unique_ptr<z_stream> z(new z_stream{});
+    const int err = inflateInit(z.get());
+    if (err != Z_OK) {
+      return SetupError("Zlib", "inflateInit", std::to_string(err));
+    }
+    inflate_ = std::move(z);
+  } else {
+    const int err = inflateReset(inflate_.get());
+    if (err != Z_OK) return ZlibError("inflateReset", err, *inflate_);
+  }
+
+  z_stream &z = *inflate_;
+  z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed.data()));
+  z.avail_in = compressed.size();
+  z.next_out = reinterpret_cast<Bytef *>(m->data());
+  z.avail_out = m->size();
+  const int err = inflate(&z, Z_FINISH);
+  if (err != Z_STREAM_END) {
+    return ZlibError("decompression", err == Z_OK ? Z_BUF_ERROR : err, z);
+  }
+  m->resize(z.total_out);
   return absl::OkStatus();
 }
 
+namespace {
+
+#ifdef HAVE_ZSTD
+// zstd at fast (negative) through high levels, each level's strategy or any
+// other. The contexts are kept and reset for each use.
+class Zstd : public Compressor {
+ public:
+  Zstd() {}
+  ~Zstd() override {
+    ZSTD_freeCCtx(cctx_);
+    ZSTD_freeDCtx(dctx_);
+  }
+  Zstd(const Zstd &) = delete;
+  Zstd &operator=(const Zstd &) = delete;
+
+  std::string Name() const override { return "ZSTD"; }
+
+  Options RandomOptions(uint64_t seed) const override {
+    std::knuth_b rng(seed);
+    Options o;
+    o.level = 1;
+    if (std::uniform_int_distribution<int>(0, 1)(rng)) {
+      o.level = std::uniform_int_distribution<int>(-5, 12)(rng);
+      // 0 leaves the level's own strategy, else ZSTD_fast to ZSTD_btultra2.
+      if (std::uniform_int_distribution<int>(0, 1)(rng)) {
+        o.strategy = std::uniform_int_distribution<int>(1, 9)(rng);
+      }
+    }
+    o.chunk = RandomChunk(&rng);
+    return o;
+  }
+
+  size_t MaxCompressedSize(size_t n) const override {
+    return ZSTD_compressBound(n) + Chunks(n, kMinChunk) * kFlushOverhead;
+  }
+
+  absl::Status Compress(const MalignBuffer &m, const Options &options,
+                        MalignBuffer *compressed) override {
+    compressed->resize(compressed->capacity());
+    if (cctx_ == nullptr) cctx_ = ZSTD_createCCtx();
+    if (cctx_ == nullptr) return SetupError(Name(), "ZSTD_createCCtx", "");
+    size_t err = ZSTD_CCtx_reset(cctx_, ZSTD_reset_session_and_parameters);
+    if (!ZSTD_isError(err)) {
+      err = ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel,
+                                   options.level);
+    }
+    if (!ZSTD_isError(err)) {
+      err = ZSTD_CCtx_setParameter(
+          cctx_, ZSTD_c_strategy, options.strategy);
+    }
+    if (ZSTD_isError(err)) {
+      return SetupError(Name(), "setup", ZSTD_getErrorName(err));
+    }
+
+    ZSTD_outBuffer out = {compressed->data(), compressed->size(), 0};
+    const size_t chunk = options.chunk ? options.chunk : m.size();
+    size_t pos = 0;
+    do {
+      const size_t n = std::min(m.size() - pos, chunk);
+      ZSTD_inBuffer in = {m.data() + pos, n, 0};
+      pos += n;
+      const ZSTD_EndDirective end =
+          pos < m.size() ? ZSTD_e_flush : ZSTD_e_end;
+      // Returns the bytes left to flush, 0 once all are.
+      do {
+        err = ZSTD_compressStream2(cctx_, &out, &in, end);
+      } while (!ZSTD_isError(err) && err != 0 && out.pos < out.size);
+      if (ZSTD_isError(err) || err != 0) {
+        return Error(Name(), "compression",
+                     ZSTD_isError(err) ? ZSTD_getErrorName(err) : "no room",
+                     pos - n + in.pos, out.pos);
+      }
+    } while (pos < m.size());
+    compressed->resize(out.pos);
+    return absl::OkStatus();
+  }
+
+  absl::Status Decompress(const MalignBuffer &compressed,
+                          MalignBuffer *m) override {
+    if (dctx_ == nullptr) dctx_ = ZSTD_createDCtx();
+    if (dctx_ == nullptr) return SetupError(Name(), "ZSTD_createDCtx", "");
+    const size_t n = ZSTD_decompressDCtx(dctx_, m->data(), m->size(),
+                                         compressed.data(), compressed.size());
+    if (ZSTD_isError(n)) {
+      return Error(Name(), "decompression", ZSTD_getErrorName(n),
+                   compressed.size(), 0);
+    }
+    m->resize(n);
+    return absl::OkStatus();
+  }
+
+ private:
+  ZSTD_CCtx *cctx_ = nullptr;
+  ZSTD_DCtx *dctx_ = nullptr;
+};
+#endif  // HAVE_ZSTD
+
+#ifdef HAVE_LZ4
+// LZ4, with its fast compressor at varying acceleration or its HC
+// compressor. The output is a series of blocks, one per chunk, each preceded
+// by its length as 4 little endian bytes, and each able to refer back to
+// those before, as LZ4's streaming API makes them.
+class Lz4 : public Compressor {
+ public:
+  Lz4() {}
+  ~Lz4() override {
+    if (stream_) LZ4_freeStream(stream_);
+    if (stream_hc_) LZ4_freeStreamHC(stream_hc_);
+    if (decode_) LZ4_freeStreamDecode(decode_);
+  }
+  Lz4(const Lz4 &) = delete;
+  Lz4 &operator=(const Lz4 &) = delete;
+
+  std::string Name() const override { return "LZ4"; }
+
+  // Level 0 is the fast compressor, with 'strategy' as its acceleration.
+  // Other levels are HC levels.
+  Options RandomOptions(uint64_t seed) const override {
+    std::knuth_b rng(seed);
+    Options o;
+    o.strategy = 1;
+    const int k = std::uniform_int_distribution<int>(0, 3)(rng);
+    if (k == 1) {
+      o.strategy = std::uniform_int_distribution<int>(2, 16)(rng);
+    } else if (k == 2) {
+      o.level = std::uniform_int_distribution<int>(LZ4HC_CLEVEL_MIN,
+                                                   LZ4HC_CLEVEL_MAX)(rng);
+    }
+    o.chunk = RandomChunk(&rng);
+    return o;
+  }
+
+  size_t MaxCompressedSize(size_t n) const override {
+    return LZ4_compressBound(n) + Chunks(n, kMinChunk) * kFlushOverhead;
+  }
+
+  absl::Status Compress(const MalignBuffer &m, const Options &options,
+                        MalignBuffer *compressed) override {
+    compressed->resize(compressed->capacity());
+    if (options.level == 0) {
+      if (stream_ == nullptr) stream_ = LZ4_createStream();
+      if (stream_ == nullptr) return SetupError(Name(), "createStream", "");
+      LZ4_resetStream_fast(stream_);
+    } else {
+      if (stream_hc_ == nullptr) stream_hc_ = LZ4_createStreamHC();
+      if (stream_hc_ == nullptr) {
+        return SetupError(Name(), "createStreamHC", "");
+      }
+      LZ4_resetStreamHC_fast(stream_hc_, options.level);
+    }
+
+    const size_t chunk = options.chunk ? options.chunk : m.size();
+    char *out = compressed->data();
+    const char *const end = out + compressed->size();
+    size_t pos = 0;
+    do {
+      const int n = std::min(m.size() - pos, chunk);
+      if (end - out < 4) {
+        return Error(Name(), "compression", "no room", pos,
+                     out - compressed->data());
+      }
+      const int room = std::min<size_t>(end - out - 4, kMaxInt);
+      const int k =
+          options.level == 0
+              ? LZ4_compress_fast_continue(stream_, m.data() + pos, out + 4,
+                                           n, room, options.strategy)
+              : LZ4_compress_HC_continue(stream_hc_, m.data() + pos, out + 4,
+                                         n, room);
+      if (k <= 0 && n > 0) {
+        return Error(Name(), "compression", std::to_string(k), pos,
+                     out - compressed->data());
+      }
+      const uint32_t length = k;
+      for (int i = 0; i < 4; i++) out[i] = length >> (8 * i);
+      out += 4 + k;
+      pos += n;
+    } while (pos < m.size());
+    compressed->resize(out - compressed->data());
+    return absl::OkStatus();
+  }
+
+  absl::Status Decompress(const MalignBuffer &compressed,
+                          MalignBuffer *m) override {
+    if (decode_ == nullptr) decode_ = LZ4_createStreamDecode();
+    if (decode_ == nullptr) {
+      return SetupError(Name(), "createStreamDecode", "");
+    }
+    LZ4_setStreamDecode(decode_, nullptr, 0);
+    const unsigned char *in =
+        reinterpret_cast<const unsigned char *>(compressed.data());
+    const unsigned char *const end = in + compressed.size();
+    size_t pos = 0;
+    while (in < end) {
+      if (end - in < 4) {
+        return Error(Name(), "decompression", "truncated length",
+                     compressed.size() - (end - in), pos);
+      }
+      const uint32_t length = in[0] | in[1] << 8 | in[2] << 16 |
+                              static_cast<uint32_t>(in[3]) << 24;
+      in += 4;
+      if (length > static_cast<size_t>(end - in)) {
+        return Error(Name(), "decompression", "truncated block",
+                     compressed.size() - (end - in), pos);
+      }
+      const int room = std::min<size_t>(m->size() - pos, kMaxInt);
+      const int k = LZ4_decompress_safe_continue(
+          decode_, reinterpret_cast<const char *>(in), m->data() + pos,
+          length, room);
+      if (k < 0) {
+        return Error(Name(), "decompression", std::to_string(k),
+                     compressed.size() - (end - in), pos);
+      }
+      in += length;
+      pos += k;
+    }
+    m->resize(pos);
+    return absl::OkStatus();
+  }
+
+ private:
+  // LZ4 counts bytes in ints.
+  static constexpr size_t kMaxInt = std::numeric_limits<int>::max();
+
+  LZ4_stream_t *stream_ = nullptr;
+  LZ4_streamHC_t *stream_hc_ = nullptr;
+  LZ4_streamDecode_t *decode_ = nullptr;
+};
+#endif  // HAVE_LZ4
+
+#ifdef HAVE_LIBDEFLATE
+// libdeflate at levels 0, from libdeflate 1.15, or 1 through 12, in zlib
+// format, so that Zlib decodes its output and it decodes Zlib's. libdeflate
+// has no streaming API, so there's no chunking. A compressor is kept for
+// each level used.
+class LibDeflate : public Compressor {
+ public:
+  // Level 1, the default, is allocated up front for MaxCompressedSize.
+  LibDeflate() {
+    compressors_[1] = libdeflate_alloc_compressor(1);
+    if (compressors_[1] == nullptr) {
+      LOG(FATAL) << "libdeflate_alloc_compressor failed";
+    }
+  }
+  ~LibDeflate() override {
+    for (libdeflate_compressor *c : compressors_) {
+      if (c) libdeflate_free_compressor(c);
+    }
+    if (decompressor_) libdeflate_free_decompressor(decompressor_);
+  }
+  LibDeflate(const LibDeflate &) = delete;
+  LibDeflate &operator=(const LibDeflate &) = delete;
+
+  std::string Name() const override { return "LIBDEFLATE"; }
+  std::string Format() const override { return "zlib"; }
+
+  Options RandomOptions(uint64_t seed) const override {
+    std::knuth_b rng(seed);
+    Options o;
+    o.level = 1;
+    if (std::uniform_int_distribution<int>(0, 1)(rng)) {
+      o.level = std::uniform_int_distribution<int>(kMinLevel, kMaxLevel)(rng);
+    }
+    return o;
+  }
+
+  size_t MaxCompressedSize(size_t n) const override {
+#if LIBDEFLATE_VERSION_MAJOR > 1 || LIBDEFLATE_VERSION_MINOR >= 15
+    // Given no compressor, libdeflate bounds the output of any level.
+    return libdeflate_zlib_compress_bound(nullptr, n);
+#else
+    // Older libdeflates bound every level alike, but need a compressor.
+    return libdeflate_zlib_compress_bound(compressors_[1], n);
+#endif
+  }
+
+  absl::Status Compress(const MalignBuffer &m, const Options &options,
+                        MalignBuffer *compressed) override {
+    compressed->resize(compressed->capacity());
+    libdeflate_compressor *&c = compressors_[options.level];
+    if (c == nullptr) c = libdeflate_alloc_compressor(options.level);
+    if (c == nullptr) {
+      return SetupError(Name(), "alloc_compressor", "");
+    }
+    const size_t n = libdeflate_zlib_compress(
+        c, m.data(), m.size(), compressed->data(), compressed->size());
+    if (n == 0) {
+      return Error(Name(), "compression", "no room", m.size(), 0);
+    }
+    compressed->resize(n);
+    return absl::OkStatus();
+  }
+
+  absl::Status Decompress(const MalignBuffer &compressed,
+                          MalignBuffer *m) override {
+    if (decompressor_ == nullptr) {
+      decompressor_ = libdeflate_alloc_decompressor();
+    }
+    if (decompressor_ == nullptr) {
+      return SetupError(Name(), "alloc_decompressor", "");
+    }
+    size_t n = 0;
+    const libdeflate_result r =
+        libdeflate_zlib_decompress(decompressor_, compressed.data(),
+                                   compressed.size(), m->data(), m->size(), &n);
+    if (r != LIBDEFLATE_SUCCESS) {
+      return Error(Name(), "decompression", std::to_string(r),
+                   compressed.size(), n);
+    }
+    m->resize(n);
+    return absl::OkStatus();
+  }
+
+ private:
+  // Level 0, storing only, and compress bounds without a compressor, came
+  // with libdeflate 1.15.
+#if LIBDEFLATE_VERSION_MAJOR > 1 || LIBDEFLATE_VERSION_MINOR >= 15
+  static constexpr int kMinLevel = 0;
+#else
+  static constexpr int kMinLevel = 1;
+#endif
+  static constexpr int kMaxLevel = 12;
+  libdeflate_compressor *compressors_[kMaxLevel + 1] = {};
+  libdeflate_decompressor *decompressor_ = nullptr;
+};
+#endif  // HAVE_LIBDEFLATE
+
+#ifdef HAVE_BROTLI
+// Brotli at qualities 0 through 9, in each of its modes. Its API can't reset
+// an encoder for reuse, so each compression makes a new one; decompression
+// is one-shot.
+class Brotli : public Compressor {
+ public:
+  std::string Name() const override { return "BROTLI"; }
+
+  // 'strategy' is the BrotliEncoderMode.
+  Options RandomOptions(uint64_t seed) const override {
+    std::knuth_b rng(seed);
+    Options o;
+    o.level = 1;
+    if (std::uniform_int_distribution<int>(0, 1)(rng)) {
+      o.level = std::uniform_int_distribution<int>(BROTLI_MIN_QUALITY, 9)(rng);
+      o.strategy = std::uniform_int_distribution<int>(BROTLI_MODE_GENERIC,
+                                                      BROTLI_MODE_FONT)(rng);
+    }
+    o.chunk = RandomChunk(&rng);
+    return o;
+  }
+
+  size_t MaxCompressedSize(size_t n) const override {
+    return BrotliEncoderMaxCompressedSize(n) +
+           Chunks(n, kMinChunk) * kFlushOverhead;
+  }
+
+  absl::Status Compress(const MalignBuffer &m, const Options &options,
+                        MalignBuffer *compressed) override {
+    compressed->resize(compressed->capacity());
+    std::unique_ptr<BrotliEncoderState, void (*)(BrotliEncoderState *)> s(
+        BrotliEncoderCreateInstance(nullptr, nullptr, nullptr),
+        BrotliEncoderDestroyInstance);
+    if (s == nullptr) return SetupError(Name(), "CreateInstance", "");
+    BrotliEncoderSetParameter(s.get(), BROTLI_PARAM_QUALITY, options.level);
+    BrotliEncoderSetParameter(s.get(), BROTLI_PARAM_MODE, options.strategy);
+    BrotliEncoderSetParameter(s.get(), BROTLI_PARAM_SIZE_HINT,
+                              std::min<size_t>(m.size(), 1 << 30));
+
+    const uint8_t *next_in = reinterpret_cast<const uint8_t *>(m.data());
+    uint8_t *next_out = reinterpret_cast<uint8_t *>(compressed->data());
+    size_t avail_out = compressed->size();
+    const size_t chunk = options.chunk ? options.chunk : m.size();
+    size_t pos = 0;
+    do {
+      size_t avail_in = std::min(m.size() - pos, chunk);
+      pos += avail_in;
+      const BrotliEncoderOperation op =
+          pos < m.size() ? BROTLI_OPERATION_FLUSH : BROTLI_OPERATION_FINISH;
+      bool ok;
+      do {
+        ok = BrotliEncoderCompressStream(s.get(), op, &avail_in, &next_in,
+                                         &avail_out, &next_out, nullptr);
+      } while (ok && avail_out &&
+               (avail_in || BrotliEncoderHasMoreOutput(s.get()) ||
+                (op == BROTLI_OPERATION_FINISH &&
+                 !BrotliEncoderIsFinished(s.get()))));
+      if (!ok || avail_in || BrotliEncoderHasMoreOutput(s.get())) {
+        return Error(Name(), "compression", ok ? "no room" : "error",
+                     pos - avail_in, compressed->size() - avail_out);
+      }
+    } while (pos < m.size());
+    if (!BrotliEncoderIsFinished(s.get())) {
+      return Error(Name(), "compression", "unfinished", pos,
+                   compressed->size() - avail_out);
+    }
+    compressed->resize(compressed->size() - avail_out);
+    return absl::OkStatus();
+  }
+
+  absl::Status Decompress(const MalignBuffer &compressed,
+                          MalignBuffer *m) override {
+    size_t n = m->size();
+    const BrotliDecoderResult r = BrotliDecoderDecompress(
+        compressed.size(), reinterpret_cast<const uint8_t *>(compressed.data()),
+        &n, reinterpret_cast<uint8_t *>(m->data()));
+    if (r != BROTLI_DECODER_RESULT_SUCCESS) {
+      return Error(Name(), "decompression", std::to_string(r),
+                   compressed.size(), 0);
+    }
+    m->resize(n);
+    return absl::OkStatus();
+  }
+};
+#endif  // HAVE_BROTLI
+
+}  // namespace
+
+Compressors::Compressors() {
+  compressors_.emplace_back(new Zlib);
+#ifdef HAVE_ZSTD
+  compressors_.emplace_back(new Zstd);
+#endif
+#ifdef HAVE_LZ4
+  compressors_.emplace_back(new Lz4);
+#endif
+#ifdef HAVE_LIBDEFLATE
+  compressors_.emplace_back(new LibDeflate);
+#endif
+#ifdef HAVE_BROTLI
+  compressors_.emplace_back(new Brotli);
+#endif
+}
+
+size_t Compressors::RandomCompressor(uint64_t seed) const {
+  std::knuth_b rng(seed);
+  return std::uniform_int_distribution<size_t>(0, compressors_.size() - 1)(
+      rng);
+}
+
+size_t Compressors::RandomDecompressor(size_t k, uint64_t seed) const {
+  std::vector<size_t> v;
+  for (size_t i = 0; i < compressors_.size(); i++) {
+    if (compressors_[i]->Format() == compressors_[k]->Format()) v.push_back(i);
+  }
+  std::knuth_b rng(seed);
+  return v[std::uniform_int_distribution<size_t>(0, v.size() - 1)(rng)];
+}
+
+std::string Compressors::Names() const {
+  std::string s;
+  for (const auto &c : compressors_) {
+    absl::StrAppend(&s, s.empty() ? "" : ", ", c->Name());
+  }
+  return s;
+}
+
 };  // namespace cpu_check
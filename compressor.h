@@ -15,34 +15,108 @@
 #ifndef THIRD_PARTY_CPU_CHECK_COMPRESSOR_H_
 #define THIRD_PARTY_CPU_CHECK_COMPRESSOR_H_
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "malign_buffer.h"
 #include "absl/status/status.h"
 
+struct z_stream_s;
+
 namespace cpu_check {
 
 class Compressor {
  public:
+  // Parameters of one compression, chosen afresh each round. Each compressor
+  // interprets 'level' and 'strategy' in its own terms.
+  struct Options {
+    int level = 0;
+    int strategy = 0;
+    // If non-zero, the input is streamed to the compressor in pieces of this
+    // many bytes, with the output flushed after each.
+    size_t chunk = 0;
+  };
+
+  // Smallest Options::chunk RandomOptions returns.
+  static constexpr size_t kMinChunk = 4096;
+
   virtual ~Compressor() {}
   virtual std::string Name() const = 0;
 
-  // Compresses 'm' into 'compressed'.
-  virtual absl::Status Compress(const MalignBuffer &m,
-                                MalignBuffer *compressed) const = 0;
+  // Returns the name of the format of Compress's output. Compressors of the
+  // same format decode one another's output.
+  virtual std::string Format() const { return Name(); }
+
+  // Returns randomly selected Options, as a function of 'seed'.
+  virtual Options RandomOptions(uint64_t seed) const = 0;
+
+  // Returns JSON fields describing 'options'.
+  virtual std::string OptionsJson(const Options &options) const;
 
-  // Decompresses 'compressed' into 'm'.
+  // Returns the largest size to which 'n' bytes may compress, with any
+  // Options RandomOptions returns.
+  virtual size_t MaxCompressedSize(size_t n) const = 0;
+
+  // Compresses 'm' into 'compressed', as 'options' specify. Returns a
+  // kFailedPrecondition error if the compressor can't be set up, for want
+  // of memory say, which is no sign of a faulty CPU; other errors may be.
+  virtual absl::Status Compress(const MalignBuffer &m, const Options &options,
+                                MalignBuffer *compressed) = 0;
+
+  // Decompresses 'compressed' into 'm'. Errors are as Compress's.
   virtual absl::Status Decompress(const MalignBuffer &compressed,
-                                  MalignBuffer *m) const = 0;
+                                  MalignBuffer *m) = 0;
 };
 
+// Deflate at levels 0 (stored) through 9, with each of zlib's strategies.
+// The deflate and inflate states, each hundreds of KiB, are allocated on
+// first use and reset for each later one, so a Zlib is for one thread.
 class Zlib : public Compressor {
  public:
+  Zlib();
+  ~Zlib() override;
+  Zlib(const Zlib &) = delete;
+  Zlib &operator=(const Zlib &) = delete;
+
   std::string Name() const override { return "ZLIB"; }
-  absl::Status Compress(const MalignBuffer &m,
-                        MalignBuffer *compressed) const override;
+  std::string Format() const override { return "zlib"; }
+  Options RandomOptions(uint64_t seed) const override;
+  size_t MaxCompressedSize(size_t n) const override;
+  absl::Status Compress(const MalignBuffer &m, const Options &options,
+                        MalignBuffer *compressed) override;
   absl::Status Decompress(const MalignBuffer &compressed,
-                          MalignBuffer *m) const override;
+                          MalignBuffer *m) override;
+
+ private:
+  // Null until first successfully initialized.
+  std::unique_ptr<z_stream_s> deflate_;
+  std::unique_ptr<z_stream_s> inflate_;
+};
+
+// Zlib and whichever of zstd, LZ4, libdeflate and Brotli were found at build
+// time. As compressors keep per-thread state, so must Compressors, and each
+// thread's has the same compressors in the same order, so they're named
+// between threads by index.
+class Compressors {
+ public:
+  Compressors();
+
+  // Returns the index of a randomly selected compressor.
+  size_t RandomCompressor(uint64_t seed) const;
+
+  // Returns the index of a randomly selected compressor that decodes the
+  // output of compressor 'k': 'k' itself, or another of the same format.
+  size_t RandomDecompressor(size_t k, uint64_t seed) const;
+
+  Compressor &compressor(size_t k) { return *compressors_[k]; }
+  const Compressor &compressor(size_t k) const { return *compressors_[k]; }
+
+  // Returns the names of the compressors, comma separated.
+  std::string Names() const;
+
+ private:
+  std::vector<std::unique_ptr<Compressor>> compressors_;
 };
 
 };      // namespace cpu_check
@@ -18,21 +18,31 @@
 // One way to extract tids from logs is extract_tids.sh.
 // Pipe its output to this program.
 //
-// By default, this code assumes 28 core dual socket machines.
+// By default, this code assumes 28 core dual socket machines with SMT siblings
+// numbered N and N + sockets * cores_per_socket. With -y it instead uses the
+// sysfs topology of the machine it runs on.
 
 #include <algorithm>
 #include <cstdio>
+#include <iostream>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "log.h"
+#include "topology.h"
 
 class BadCore {
  public:
   BadCore(int sockets, int cores_per_socket)
       : sockets_(sockets), cores_per_socket_(cores_per_socket) {}
 
+  // Uses 'topology' to map tids to cores, if non-empty.
+  void set_topology(const cpu_check::CpuTopology &topology) {
+    topology_ = topology;
+    max_tid_ = topology_.empty() ? -1 : topology_.Cpus().back();
+  }
+
   // Condemns thread 'tid'.
   void Condemn(int tid) {
     std::vector<int> c({TidToCanonicalCore(tid)});
@@ -69,6 +79,7 @@ class BadCore {
 
   // Returns true if tid within legitimate range.
   bool Plausible(int tid) const {
+    if (!topology_.empty()) return topology_.cpu(tid) != nullptr;
     return (tid >= 0) && (tid < (2 * sockets_ * cores_per_socket_));
   }
 
@@ -78,7 +89,7 @@ class BadCore {
     int worst = -1;
     int worst_k = -1;
     bool ambiguous = false;
-    for (int c = 0; c < sockets_ * cores_per_socket_; c++) {
+    for (int c = 0; c < CanonicalCoreLimit(); c++) {
       const int k = AccusationCount(c);
       if (k == 0) continue;
       if (k > worst_k) {
@@ -118,11 +129,27 @@ class BadCore {
     accused_ = temp;
   }
 
+  // Returns upper bound of canonical core numbers.
+  int CanonicalCoreLimit() const {
+    if (!topology_.empty()) return max_tid_ + 1;
+    return sockets_ * cores_per_socket_;
+  }
+
   int TidToCanonicalCore(int tid) const {
+    if (!topology_.empty()) return topology_.CanonicalCore(tid);
     return tid % (sockets_ * cores_per_socket_);
   }
 
   std::string CanonicalCoreToString(int canonical_core) const {
+    if (!topology_.empty()) {
+      const cpu_check::CpuTopology::Cpu *c = topology_.cpu(canonical_core);
+      std::stringstream s;
+      s << "CPU" << c->package << " HT";
+      for (size_t i = 0; i < c->smt_siblings.size(); i++) {
+        s << (i ? "-" : "") << c->smt_siblings[i];
+      }
+      return s.str();
+    }
     const int socket = canonical_core / cores_per_socket_;
     const int a = canonical_core;
     const int b = canonical_core + sockets_ * cores_per_socket_;
@@ -136,17 +163,21 @@ class BadCore {
   std::vector<std::vector<int>> accused_;
   std::vector<std::pair<int, int>> condemned_;
   bool ambiguous_ = false;
+  cpu_check::CpuTopology topology_;
+  int max_tid_ = -1;
 };
 
 static void UsageIf(bool v) {
   if (!v) return;
-  LOG(ERROR) << "Usage corrupt_cores [-c cores_per_socket] [-s sockets]";
+  LOG(ERROR) << "Usage corrupt_cores [-c cores_per_socket] [-s sockets] [-y]"
+             << "\n  y: Use this machine's CPU topology from sysfs";
   exit(2);
 }
 
 int main(int argc, char **argv) {
   int sockets = 2;            // Default: dual socket
   int cores_per_socket = 28;  // Default: C28
+  bool use_sysfs = false;
   for (int i = 1; i < argc; i++) {
     const char *flag = argv[i];
     UsageIf(flag[0] != '-');
@@ -166,6 +197,9 @@ int main(int argc, char **argv) {
           UsageIf((s >> sockets).fail());
           break;
         }
+        case 'y':
+          use_sysfs = true;
+          break;
         default:
           UsageIf(true);
       }
@@ -175,6 +209,12 @@ int main(int argc, char **argv) {
 
   std::string line;
   BadCore bad(sockets, cores_per_socket);
+  if (use_sysfs) {
+    const cpu_check::CpuTopology topology =
+        cpu_check::CpuTopology::FromSysfs();
+    UsageIf(topology.empty());
+    bad.set_topology(topology);
+  }
 
   while (std::getline(std::cin, line)) {
     std::istringstream ss(line);
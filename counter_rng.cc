@@ -0,0 +1,99 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "counter_rng.h"
+
+#include <cstring>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define X86_TARGET_ATTRIBUTE(s) __attribute__((target(s)))
+#else
+#define X86_TARGET_ATTRIBUTE(s)
+#endif
+
+namespace cpu_check {
+namespace {
+
+using FillFn = void (*)(uint64_t seed, uint64_t i, uint64_t* dst, size_t n);
+
+constexpr uint64_t kGamma = 0x9e3779b97f4a7c15;  // As CounterRng's
+
+typedef uint64_t Scalar __attribute__((vector_size(8)));
+typedef uint64_t Lanes4 __attribute__((vector_size(32)));
+typedef uint64_t Lanes8 __attribute__((vector_size(64)));
+
+// Lanes of 'V' hold consecutive words of the stream. Inlined into callers
+// compiled for the instruction set 'V' suits.
+template <typename V>
+__attribute__((always_inline)) inline void FillLanes(uint64_t seed,
+                                                     uint64_t i,
+                                                     uint64_t* dst, size_t n) {
+  constexpr size_t kLanes = sizeof(V) / sizeof(uint64_t);
+  V z;
+  for (size_t l = 0; l < kLanes; l++) z[l] = seed + (i + l) * kGamma;
+  size_t k = 0;
+  for (; k + kLanes <= n; k += kLanes) {
+    V v = z;
+    v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9;
+    v = (v ^ (v >> 27)) * 0x94d049bb133111eb;
+    v = v ^ (v >> 31);
+    memcpy(dst + k, &v, sizeof(v));
+    z += kLanes * kGamma;
+  }
+  if constexpr (kLanes > 1) {
+    if (k < n) FillLanes<Scalar>(seed, i + k, dst + k, n - k);
+  }
+}
+
+void ScalarFill(uint64_t seed, uint64_t i, uint64_t* dst, size_t n) {
+  FillLanes<Scalar>(seed, i, dst, n);
+}
+
+X86_TARGET_ATTRIBUTE("avx2")
+void Avx2Fill(uint64_t seed, uint64_t i, uint64_t* dst, size_t n) {
+  FillLanes<Lanes4>(seed, i, dst, n);
+}
+
+// AVX512DQ has the 64 bit lane multiply.
+X86_TARGET_ATTRIBUTE("avx512f,avx512dq")
+void Avx512Fill(uint64_t seed, uint64_t i, uint64_t* dst, size_t n) {
+  FillLanes<Lanes8>(seed, i, dst, n);
+}
+
+struct FillImpl {
+  FillFn fill;
+  const char* name;
+};
+
+// Returns the widest implementation this CPU supports.
+const FillImpl& Best() {
+  static const FillImpl impl = []() -> FillImpl {
+#if defined(__i386__) || defined(__x86_64__)
+    if (__builtin_cpu_supports("avx512dq")) return {Avx512Fill, "avx512"};
+    if (__builtin_cpu_supports("avx2")) return {Avx2Fill, "avx2"};
+#endif
+    return {ScalarFill, "scalar"};
+  }();
+  return impl;
+}
+
+}  // namespace
+
+void CounterRng::Fill(uint64_t i, uint64_t* dst, size_t n) const {
+  Best().fill(seed_, i, dst, n);
+}
+
+std::string CounterRng::Impl() { return Best().name; }
+
+}  // namespace cpu_check
@@ -0,0 +1,56 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CPU_CHECK_COUNTER_RNG_H_
+#define THIRD_PARTY_CPU_CHECK_COUNTER_RNG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace cpu_check {
+
+// Counter-based pseudo random generator. Word 'i' of a stream is SplitMix64's
+// finalizer applied to the stream's seed plus a multiple of 'i', so any word,
+// or range of words, may be generated independently of the others, and many
+// words at once in SIMD lanes.
+class CounterRng {
+ public:
+  explicit CounterRng(uint64_t seed) : seed_(Mix(seed)) {}
+
+  // Returns word 'i' of the stream.
+  uint64_t operator[](uint64_t i) const { return Mix(seed_ + i * kGamma); }
+
+  // Writes words 'i' through 'i + n - 1' of the stream to 'dst'.
+  void Fill(uint64_t i, uint64_t* dst, size_t n) const;
+
+  // Returns name of the implementation Fill uses: "avx512", "avx2" or
+  // "scalar".
+  static std::string Impl();
+
+ private:
+  static constexpr uint64_t kGamma = 0x9e3779b97f4a7c15;
+
+  static uint64_t Mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  const uint64_t seed_;
+};
+
+}  // namespace cpu_check
+#endif  // THIRD_PARTY_CPU_CHECK_COUNTER_RNG_H_
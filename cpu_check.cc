@@ -36,6 +36,7 @@
 #include <memory>
 #include <mutex>
 #include <random>
+#include <set>
 #include <string>
 #include <thread>
 #include <utility>
@@ -46,21 +47,31 @@
 #include "absl/debugging/symbolize.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
 
 #include "avx.h"
+#include "blake3.h"
 #include "compressor.h"
+#include "counter_rng.h"
 #include "crc32c.h"
 #include "crypto.h"
 #include "fvt_controller.h"
 #include "hasher.h"
+#include "highway_hash.h"
 #include "log.h"
 #include "malign_buffer.h"
+#include "mpsc_queue.h"
 #include "pattern_generator.h"
+#include "round_stats.h"
+#include "sha_lanes.h"
+#include "simd_isa.h"
 #include "silkscreen.h"
 #include "stopper.h"
+#include "topology.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "utils.h"
+#include "xxh3.h"
 
 #undef HAS_FEATURE_MEMORY_SANITIZER
 #if defined(__has_feature)
@@ -84,8 +95,10 @@ static void SleepForMillis(int64_t millis) {
   }
 }
 
-std::atomic_uintmax_t errorCount(0);
-std::atomic_uintmax_t successCount(0);
+// Times each tid was named the likely culprit of a corruption, indexed by
+// tid. Sized in main(). Corruption is rare, so unlike Workers' RoundCounters,
+// these needn't be kept apart.
+std::vector<std::atomic<uint64_t>> suspect_counts;
 static constexpr uintmax_t kErrorLimit = 2000;
 
 #if defined(__i386__) || defined(__x86_64__)
@@ -115,8 +128,13 @@ bool do_avx_heavy = Avx::can_do_avx();
 bool do_compress = true;
 bool do_encrypt = true;
 bool do_hashes = true;
+bool do_all_hashes = false;
 bool do_misalign = true;
 bool do_hop = true;
+bool do_pipeline = false;
+cpu_check::CheckerPolicy checker_policy = cpu_check::kCheckAnywhere;
+cpu_check::BufferPlacement buffer_placement = cpu_check::kPlaceFirstTouch;
+cpu_check::CpuTopology topology;  // const after startup
 bool do_ssl_self_check = true;
 bool do_flush = false;  // Default: disabled for now
 bool do_provenance = false;
@@ -212,20 +230,82 @@ class NoiseScheduler {
   }
 };
 
+// The tids under test, which change as CPUs go offline or online, or as the
+// process's cpuset changes.
+class TidList {
+ public:
+  // All tids ever listed must be less than 'limit'.
+  TidList(std::vector<int> tids, int limit) : limit_(limit) {
+    Set(std::move(tids));
+  }
+
+  // Returns a snapshot of the tids. Thread safe.
+  std::shared_ptr<const std::vector<int>> Get() const {
+    return std::atomic_load(&tids_);
+  }
+
+  // Replaces the tids. Thread safe.
+  void Set(std::vector<int> tids) {
+    std::atomic_store(&tids_, std::shared_ptr<const std::vector<int>>(
+                                  new std::vector<int>(std::move(tids))));
+  }
+
+  int limit() const { return limit_; }
+
+ private:
+  const int limit_;
+  std::shared_ptr<const std::vector<int>> tids_;
+};
+
 class Worker {
  public:
-  // Does not take ownership of 'silkscreen' or 'stopper'.
-  Worker(int pid, std::vector<int> tid_list, int tid,
+  // Does not take ownership of 'tids', 'silkscreen' or 'stopper'.
+  Worker(int pid, const TidList *tids, int tid,
          cpu_check::Silkscreen *silkscreen, Stopper *stopper)
       : pid_(pid),
         tid_(tid),
-        tid_list_(tid_list),
+        tids_(tids),
         silkscreen_(silkscreen),
         stopper_(stopper),
-        rndeng_(std::random_device()()) {}
+        rndeng_(std::random_device()()),
+        inbox_(tids->limit() * kPipelineDepth),
+        returns_(kPipelineDepth) {}
   ~Worker() {}
+
+  // Runs rounds on CPU 'tid'. Checks each round either by hopping to checker
+  // CPUs or, if 'do_pipeline', by handing it to the checkers' Workers.
   void Run();
 
+  // Pipelined mode only: runs on CPU 'tid', checking rounds handed over by
+  // other Workers' Run().
+  void RunChecker();
+
+  // Pipelined mode only: sets the checker Workers, indexed by tid, to which
+  // Run() hands rounds. Does not take ownership.
+  void set_checkers(const std::vector<std::atomic<Worker *>> *checkers) {
+    checkers_ = checkers;
+  }
+
+  // Parks, or resumes, the Worker, e.g. when its CPU goes offline. A parked
+  // writer runs no rounds, a parked checker passes rounds on unchecked.
+  // Thread safe.
+  void set_parked(bool parked) { parked_ = parked; }
+
+  int tid() const { return tid_; }
+
+  // Bytes of buffers allocated for this Worker's rounds. Thread safe.
+  size_t buffer_bytes() const { return buffer_bytes_; }
+
+  // Outcomes of rounds written, or checks made, by this Worker. Updated only
+  // by the Worker's thread, may be read (via MergeFrom) from any thread.
+  const cpu_check::RoundCounters &counters() const { return counters_; }
+
+  // Per-stage round latencies. Updated only by the Worker's thread, may be
+  // read (via MergeFrom) from any thread.
+  const cpu_check::StageHistograms &stage_histograms() const {
+    return stage_histograms_;
+  }
+
  private:
   static constexpr size_t kBufMin = 12;
 #ifdef HAVE_FEATURE_MEMORY_SANITIZER
@@ -236,30 +316,69 @@ class Worker {
   static constexpr size_t kBufMax = 1 << 20;  // 1 MiB
 #endif
 
+  // Size of the pieces in which CheckComputations re-makes patterns.
+  static constexpr size_t kReMakePiece = 32 * 1024;
+
+  // Maximum number of rounds a Worker has out with checkers in pipelined mode.
+  static constexpr int kPipelineDepth = 2;
+  // How long idle pipeline stages sleep before polling again.
+  static constexpr int kPollMicros = 50;
+  // How long an exiting writer waits for rounds still out with checkers.
+  static constexpr double kDrainSeconds = 1;
+
   struct BufferSet {
-    void Alloc(std::unique_ptr<MalignBuffer> *p) {
-      if (!*p) {
-        // Allocate buffer larger than kBufMax because compression can, in some
-        // cases of random plain text, cause some expansion.
-        p->reset(new MalignBuffer(2 * kBufMax + 1024));
+    // Accounts allocated bytes in '*footprint', which must outlive 'this'.
+    explicit BufferSet(std::atomic<size_t> *footprint)
+        : footprint(footprint) {}
+    ~BufferSet() { *footprint -= bytes; }
+
+    // Ensures '*p' can hold 'size' bytes, at any alignment, on NUMA
+    // 'nodes'. Buffers only grow, so settle after a few rounds at the largest
+    // size their stage needs. Only buffers placed on nodes are mapped, the
+    // rest come from the heap.
+    void Alloc(std::unique_ptr<MalignBuffer> *p, size_t size,
+               const std::vector<int> &nodes) {
+      const bool mapped = !nodes.empty();
+      if (!*p || (*p)->capacity() < size || (mapped && !(*p)->mapped())) {
+        if (*p) Account(-static_cast<ssize_t>((*p)->capacity()));
+        p->reset(new MalignBuffer(size, mapped));
+        Account(size);
       }
+      if ((*p)->mapped()) (*p)->SetNumaNodes(nodes);
+    }
+
+    // Returns the scratch buffer not holding 'head'.
+    std::unique_ptr<MalignBuffer> *OtherScratch(const MalignBuffer *head) {
+      return head == scratch[0].get() ? &scratch[1] : &scratch[0];
+    }
+
+    void Account(ssize_t delta) {
+      bytes += delta;
+      *footprint += delta;
     }
 
-    // The buffers holding successive data transformations. Some transformations
-    // are optional, so some buffers may be unused.
+    // The buffers holding successive data transformations by the writer.
+    // Some transformations are optional, so some buffers may be unused.
     std::unique_ptr<MalignBuffer> original;
     std::unique_ptr<MalignBuffer> compressed;
     std::unique_ptr<MalignBuffer> encrypted;
     std::unique_ptr<MalignBuffer> copied;
-    std::unique_ptr<MalignBuffer> decrypted;
-    std::unique_ptr<MalignBuffer> decompressed;
-    std::unique_ptr<MalignBuffer> re_made;
+    // The checker's buffers. Decryption and decompression each write
+    // whichever one does not hold the previous stage's result.
+    std::unique_ptr<MalignBuffer> scratch[2];
 
-    // The plain-text buffer that was encrypted, if encryption was performed.
+    // The plain-text buffer that was encrypted, if encryption was performed
+    // other than in place.
     MalignBuffer *pre_encrypted = nullptr;
     // The result of the series of transformations up to, but not including,
     // the final copy.
     MalignBuffer *pre_copied = nullptr;
+    // Whether a check decrypted 'copied' in place, so it no longer holds the
+    // copy.
+    bool copied_decrypted = false;
+
+    std::atomic<size_t> *const footprint;
+    size_t bytes = 0;  // Allocated by this BufferSet
   };
 
   // Computation parameters.
@@ -270,9 +389,32 @@ class Worker {
     MalignBuffer::CopyMethod copy_method;
     cpu_check::PatternGenerator const *pattern_generator = nullptr;
     cpu_check::Hasher const *hasher = nullptr;
+    // Vector instruction sets the writer hashes and the checker rehashes
+    // with, for hashers that have an implementation per set.
+    cpu_check::SimdIsa hash_isa;
+    cpu_check::SimdIsa check_isa;
+    // Indices into each Worker's Compressors: the writer's compressor, and
+    // the checker's decompressor, which may be another of the same format.
+    size_t compressor;
+    size_t decompressor;
+    cpu_check::Compressor::Options compress_options;
+    // Encrypt the compressed buffer in place, rather than into another.
+    bool encrypt_in_place;
+    // Decrypt the copy in place, rather than into scratch.
+    bool decrypt_in_place;
     size_t buf_size;
     MalignBuffer::PunchedHole hole;
-    std::string summary;
+    uint64_t round;
+    int turbo_mhz;  // 0 if no FVT.
+    std::vector<int> checker_tids;
+  };
+
+  // Identifies a round, and the CPUs writing and reading it, in failure
+  // records. Cheap to make, it's rendered to JSON only on failure.
+  struct RoundIdent {
+    const Choices *choices;
+    int writer;
+    int reader = -1;  // None if negative
   };
 
   // Various checksums produced in the course of the series of data
@@ -283,6 +425,19 @@ class Worker {
     cpu_check::Crypto::CryptoPurse crypto_purse;
   };
 
+  // A computed round, in flight from its writer through its checkers in
+  // pipelined mode, and back to the writer for reuse of its buffers.
+  struct Handoff {
+    Worker *writer;
+    std::unique_ptr<BufferSet> buffers;
+    Choices choices;
+    Checksums checksums;
+    size_t next_checker = 0;  // Index into choices.checker_tids
+    std::vector<int> failing_tids;
+    bool checked = false;  // All checkers needed have given a verdict.
+    uint64_t t_sent = 0;   // Ticks() when last queued for a checker.
+  };
+
   uint64_t Seed() { return std::uniform_int_distribution<uint64_t>()(rndeng_); }
   size_t Alignment();
   void MaybeFlush(const MalignBuffer &s);
@@ -297,45 +452,87 @@ class Worker {
   // Returns 'Choices' that seed the data transformations.
   Choices MakeChoices(BufferSet *b);
 
+  // Returns the NUMA nodes for a buffer of the round identified by 'ident',
+  // per 'buffer_placement': written on its writer and checked on its reader
+  // or, before it has one, its first checker. See
+  // CpuTopology::PlacementNodes.
+  std::vector<int> BufferNodes(const RoundIdent &ident,
+                               bool checker_side) const {
+    const int checker = ident.reader >= 0
+                            ? ident.reader
+                            : ident.choices->checker_tids.front();
+    return topology.PlacementNodes(buffer_placement, ident.writer, checker,
+                                   checker_side);
+  }
+
+  // Returns JSON fields describing a round's Choices.
+  std::string Summary(const Choices &c) const;
+
+  // Returns JSON fields identifying a round, for failure records.
+  std::string Ident(const RoundIdent &ident) const;
+
   // Performs a series of data transformations.
   // Returns an error status if computation is detected to be corrupt.
-  absl::StatusOr<Checksums> DoComputations(const std::string &writer_ident,
-                                           const Choices &choices,
+  absl::StatusOr<Checksums> DoComputations(const RoundIdent &ident,
                                            BufferSet *b);
 
   // Inverts DoComputations, checking correctness of results.
   // Returns an error status if corruption is detected.
-  absl::Status CheckComputations(const std::string &writer_reader_ident,
-                                 const Choices &choices,
+  absl::Status CheckComputations(const RoundIdent &ident,
                                  const Checksums &checksums, BufferSet *b);
 
   // Emits a failure record.
-  // TODO: bump error count here, and maybe log, instead of at every
-  // call site.
   std::string Jfail(absl::string_view err, const absl::string_view v) {
-    if (errorCount > error_limit) {
-      stopper_->Stop();
-      LOG(INFO) << "I am quitting after " << errorCount << " errors";
-    }
     return "{ " + JsonRecord("fail", absl::StrCat(Json("err", err), ", ", v)) +
            ", " + JTag() + " }";
   }
 
-  absl::Status ReturnError(absl::string_view err, const absl::string_view v) {
+  // Counts a failure of 'stage' and returns an error status bearing its
+  // failure record.
+  absl::Status ReturnError(cpu_check::Stage stage, absl::string_view err,
+                           const absl::string_view v) {
+    counters_.AddFailure(stage);
     return absl::Status(absl::StatusCode::kInternal, Jfail(err, v));
   }
 
-  std::string Suspect(int tid) {
-    return absl::StrFormat("Suspect LPU: %d", tid);
+  // Logs, and counts, 'tid' as the likely culprit of a corruption.
+  void ReportSuspect(int tid) {
+    LOG(ERROR) << absl::StrFormat("Suspect LPU: %d", tid);
+    suspect_counts[tid]++;
   }
 
   // Returns two tids to be used for checking computation. If 'do_hop',
-  // CheckerTids avoids duplication and avoids 'tid_' if it can.
+  // CheckerTids avoids duplication and avoids 'tid_' if it can, and prefers
+  // tids satisfying 'checker_policy'.
   std::vector<int> CheckerTids();
 
+  // Returns JSON record identifying 'tid', with FVT conditions if known.
+  std::string TidJson(int tid) const;
+
+  // Logs the verdict on a round checked by 'checker_tids', of which
+  // 'failing_tids' found it corrupt.
+  void ReportChecks(const std::vector<int> &failing_tids);
+
+  // Pipelined mode: returns a BufferSet for the next round, waiting for one
+  // to come back from the checkers if kPipelineDepth are out. Returns
+  // nullptr if the run expires while waiting.
+  std::unique_ptr<BufferSet> ReclaimBufferSet();
+
+  // Pipelined mode: reports the verdicts on rounds returned once the run
+  // has expired, waiting up to kDrainSeconds for those still out. Rounds a
+  // checker stopped before checking never return.
+  void DrainReturns();
+
+  // Pipelined mode: queues 'h' for its next checker, or returns it to its
+  // writer if all checkers have seen it. Returns false if the run expired.
+  static bool Forward(std::unique_ptr<Handoff> h);
+
+  // Pipelined mode: checks the round in 'h' and forwards it.
+  void Check(std::unique_ptr<Handoff> h);
+
   const uint64_t pid_;
   const int tid_;
-  const std::vector<int> tid_list_;
+  const TidList *const tids_;
   cpu_check::Silkscreen *const silkscreen_;
   Stopper *const stopper_;
 
@@ -346,9 +543,28 @@ class Worker {
   Avx avx_;
   cpu_check::PatternGenerators pattern_generators_;
   cpu_check::Hashers hashers_;
-  cpu_check::Zlib zlib_;
+  cpu_check::Compressors compressors_;
+  cpu_check::Crypto crypto_;
+  cpu_check::StageHistograms stage_histograms_;
+  cpu_check::RoundCounters counters_;
 
   std::unique_ptr<FVTController> fvt_controller_;
+  std::atomic_bool parked_ = false;
+  // Bytes allocated by this Worker's BufferSets, wherever they are. Declared
+  // before the queues, whose BufferSets it must outlive.
+  std::atomic<size_t> buffer_bytes_ = 0;
+  // Scratch for re-making patterns, see CheckComputations.
+  std::unique_ptr<MalignBuffer> re_make_piece_;
+
+  // Pipelined mode state.
+  const std::vector<std::atomic<Worker *>> *checkers_ = nullptr;
+  // Rounds waiting to be checked by this Worker's RunChecker().
+  cpu_check::MpscQueue<std::unique_ptr<Handoff>> inbox_;
+  // Checked rounds returned to this Worker's Run().
+  cpu_check::MpscQueue<std::unique_ptr<Handoff>> returns_;
+  int in_flight_ = 0;
+  // Last round whose silkscreen slots were written, 0 if none.
+  uint64_t silkscreen_round_ = 0;
 };
 
 std::string Worker::FVT() const {
@@ -433,104 +649,189 @@ Worker::Choices Worker::MakeChoices(BufferSet *b) {
       std::uniform_int_distribution<int>(0, 20)(rndeng_) == 0;
 
   c.pattern_generator = &pattern_generators_.RandomGenerator(round_);
-  c.hasher = &hashers_.RandomHasher(round_);
-
+  c.hasher = do_all_hashes ? &hashers_.AllHasher()
+                           : &hashers_.RandomHasher(round_);
+  // Rehash with another instruction set than hashed with, where the CPU
+  // supports more than one.
+  const std::vector<cpu_check::SimdIsa> &isas = cpu_check::SupportedSimdIsas();
+  const size_t n = isas.size();
+  const size_t h = std::uniform_int_distribution<size_t>(0, n - 1)(rndeng_);
+  c.hash_isa = isas[h];
+  c.check_isa = isas[h];
+  if (n > 1) {
+    const size_t d = std::uniform_int_distribution<size_t>(1, n - 1)(rndeng_);
+    c.check_isa = isas[(h + d) % n];
+  }
+  c.compressor = compressors_.RandomCompressor(Seed());
+  c.decompressor = compressors_.RandomDecompressor(c.compressor, Seed());
+  c.compress_options =
+      compressors_.compressor(c.compressor).RandomOptions(Seed());
+  // Only the compressed text isn't needed again once encrypted.
+  c.encrypt_in_place =
+      do_compress && do_encrypt &&
+      std::uniform_int_distribution<int>(0, 1)(rndeng_);
+  // The copy isn't needed again once verified.
+  c.decrypt_in_place =
+      do_encrypt && std::uniform_int_distribution<int>(0, 1)(rndeng_);
+
+  c.round = round_;
+  // Chosen up front so buffers may be placed near the checker.
+  c.checker_tids = CheckerTids();
   c.buf_size = std::uniform_int_distribution<size_t>(kBufMin, kBufMax)(rndeng_);
-  if (!b->original) b->Alloc(&b->original);
+  b->Alloc(&b->original, c.buf_size, BufferNodes({&c, tid_}, false));
   b->original->Initialize(Alignment(), c.buf_size);
   c.hole = b->original->RandomPunchedHole(Seed());
+  return c;
+}
 
-  c.summary = absl::StrCat(
+std::string Worker::Summary(const Choices &c) const {
+  return absl::StrCat(
       Json("pattern", c.pattern_generator->Name()), ", ",
       Json("hash", c.hasher->Name()), ", ",
+      Json("hash_isa", cpu_check::ToString(c.hash_isa)), ", ",
+      Json("check_isa", cpu_check::ToString(c.check_isa)), ", ",
+      JsonRecord(
+          "compress",
+          absl::StrCat(
+              Json("name", compressors_.compressor(c.compressor).Name()),
+              ", ",
+              Json("decoder", compressors_.compressor(c.decompressor).Name()),
+              ", ",
+              compressors_.compressor(c.compressor)
+                  .OptionsJson(c.compress_options))),
+      ", ", JsonBool("encrypt_in_place", c.encrypt_in_place), ", ",
+      JsonBool("decrypt_in_place", c.decrypt_in_place), ", ",
       Json("copy", MalignBuffer::ToString(c.copy_method)), ", ",
       Json("memset", c.use_repstos ? "rep;sto" : "memset"), ", ",
       JsonBool("madvise", c.madvise), ", ", Json("size", c.buf_size), ", ",
-      Json("pid", pid_), ", ", Json("round", round_), ", ", c.hole.ToString());
+      Json("pid", pid_), ", ", Json("round", c.round), ", ", c.hole.ToString());
+}
 
-  return c;
+std::string Worker::Ident(const RoundIdent &ident) const {
+  std::string s = "\"writer\": " + TidJson(ident.writer);
+  if (ident.reader >= 0) {
+    absl::StrAppend(&s, ", \"reader\": ", TidJson(ident.reader));
+  }
+  absl::StrAppend(&s, ", ", Json("turbo", ident.choices->turbo_mhz), ", ",
+                  Summary(*ident.choices));
+  return s;
 }
 
 absl::StatusOr<Worker::Checksums> Worker::DoComputations(
-    const std::string &writer_ident, const Choices &choices, BufferSet *b) {
+    const RoundIdent &ident, BufferSet *b) {
+  const Choices &choices = *ident.choices;
   Checksums checksums;
+  cpu_check::StageTimer timer(&stage_histograms_);
   if (do_avx_heavy) {
     const std::string e = avx_.MaybeGoHot();
     if (!e.empty()) {
-      return ReturnError(e, writer_ident);
+      return ReturnError(cpu_check::kStageAvx, e, Ident(ident));
     }
+    timer.Lap(cpu_check::kStageAvx);
   }
 
   if (do_ssl_self_check) {
     auto s = cpu_check::Crypto::SelfTest();
     if (!s.ok()) {
-      return ReturnError(s.message(), writer_ident);
+      return ReturnError(cpu_check::kStageSelfTest, s.message(),
+                         Ident(ident));
     }
+    timer.Lap(cpu_check::kStageSelfTest);
+  }
+
+  if (do_pipeline && silkscreen_round_) {
+    // Checkers run concurrently with our next round, so can't check our
+    // slots. Check them here before overwriting. Other CPUs' slots share the
+    // same cache lines, so this still exercises coherence.
+    auto s = silkscreen_->CheckMySlots(tid_, silkscreen_round_);
+    if (!s.ok()) {
+      return ReturnError(cpu_check::kStageSilkscreenCheck, "Silkscreen",
+                         absl::StrCat(s.message(), ", ", Ident(ident)));
+    }
+    timer.Lap(cpu_check::kStageSilkscreenCheck);
   }
 
   auto s = silkscreen_->WriteMySlots(tid_, round_);
   if (!s.ok()) {
-    return ReturnError("Silkscreen",
-                       absl::StrCat(s.message(), ", ", writer_ident));
+    return ReturnError(cpu_check::kStageSilkscreenWrite, "Silkscreen",
+                       absl::StrCat(s.message(), ", ", Ident(ident)));
   }
+  silkscreen_round_ = round_;
+  timer.Lap(cpu_check::kStageSilkscreenWrite);
 
   if (do_avx_heavy) {
     // If we tried to do AVX heavy stuff. Try to run AVX heavy again to try
     // to spike current.
     const std::string e = avx_.BurnIfAvxHeavy();
     if (!e.empty()) {
-      return ReturnError(e, writer_ident);
+      return ReturnError(cpu_check::kStageAvx, e, Ident(ident));
     }
+    timer.Lap(cpu_check::kStageAvx);
   }
 
   checksums.floating_point_results = pattern_generators_.Generate(
       *choices.pattern_generator, choices.hole, round_, choices.copy_method,
       choices.use_repstos, choices.exercise_floating_point, b->original.get());
   MaybeFlush(*b->original);
+  timer.Lap(cpu_check::kStageGenerate);
 
   MalignBuffer *head = b->original.get();
 
   if (do_hashes) {
-    checksums.hash_value = choices.hasher->Hash(*head);
+    checksums.hash_value = choices.hasher->HashWith(*head, choices.hash_isa);
+    timer.Lap(cpu_check::kStageHash);
   }
 
   if (do_compress) {
     // Run our randomly chosen compressor.
-    if (!b->compressed) b->Alloc(&b->compressed);
+    cpu_check::Compressor &compressor =
+        compressors_.compressor(choices.compressor);
+    b->Alloc(&b->compressed, compressor.MaxCompressedSize(choices.buf_size),
+             BufferNodes(ident, false));
     b->compressed->Initialize(Alignment(), choices.buf_size);
     MaybeFlush(*b->compressed);
 
-    const auto s = zlib_.Compress(*head, b->compressed.get());
+    const auto s =
+        compressor.Compress(*head, choices.compress_options,
+                            b->compressed.get());
     if (!s.ok()) {
+      // A compressor that couldn't be set up says nothing of the CPU.
+      if (absl::IsFailedPrecondition(s)) return s;
       return ReturnError(
-          "Compression",
-          absl::StrCat(Json("syndrome", s.message()), ", ", writer_ident));
+          cpu_check::kStageCompress, "Compression",
+          absl::StrCat(Json("syndrome", s.message()), ", ", Ident(ident)));
     }
     MaybeFlush(*b->compressed);
     head = b->compressed.get();
+    timer.Lap(cpu_check::kStageCompress);
   }
 
-  b->pre_encrypted = head;
+  b->pre_encrypted = choices.encrypt_in_place ? nullptr : head;
   if (do_encrypt) {
     // Encrypt.
-    if (!b->encrypted) b->Alloc(&b->encrypted);
-    b->encrypted->Initialize(Alignment(), head->size());
-    MaybeFlush(*b->encrypted);
-    if (choices.madvise) b->encrypted->MadviseDontNeed();
+    MalignBuffer *encrypted = head;
+    if (!choices.encrypt_in_place) {
+      b->Alloc(&b->encrypted, head->size(), BufferNodes(ident, false));
+      b->encrypted->Initialize(Alignment(), head->size());
+      MaybeFlush(*b->encrypted);
+      if (choices.madvise) b->encrypted->MadviseDontNeed();
+      encrypted = b->encrypted.get();
+    }
 
-    auto s = cpu_check::Crypto::Encrypt(*head, b->encrypted.get(),
-                                        &checksums.crypto_purse);
+    auto s = crypto_.Encrypt(*head, encrypted, &checksums.crypto_purse);
     if (!s.ok()) {
-      return ReturnError(s.message(), writer_ident);
+      return ReturnError(cpu_check::kStageEncrypt, s.message(), Ident(ident));
     }
 
-    MaybeFlush(*b->encrypted);
-    head = b->encrypted.get();
+    MaybeFlush(*encrypted);
+    head = encrypted;
+    timer.Lap(cpu_check::kStageEncrypt);
   }
 
   // Make a copy.
   b->pre_copied = head;
-  if (!b->copied) b->Alloc(&b->copied);
+  b->copied_decrypted = false;
+  b->Alloc(&b->copied, head->size(), BufferNodes(ident, true));
   b->copied->Initialize(Alignment(), head->size());
   MaybeFlush(*b->copied);
   if (choices.madvise) b->copied->MadviseDontNeed();
@@ -538,109 +839,151 @@ absl::StatusOr<Worker::Checksums> Worker::DoComputations(
 
   if (!syndrome.empty()) {
     return ReturnError(
-        "writer-detected-copy",
-        absl::StrCat(JsonRecord("syndrome", syndrome), ", ", writer_ident));
+        cpu_check::kStageCopy, "writer-detected-copy",
+        absl::StrCat(JsonRecord("syndrome", syndrome), ", ", Ident(ident)));
   }
   MaybeFlush(*b->copied);
+  timer.Lap(cpu_check::kStageCopy);
   return checksums;
 }
 
-absl::Status Worker::CheckComputations(const std::string &writer_reader_ident,
-                                       const Choices &choices,
+absl::Status Worker::CheckComputations(const RoundIdent &ident,
                                        const Checksums &checksums,
                                        BufferSet *b) {
-  // Re-verify buffer copy
-  std::string syndrome = b->copied->Syndrome(*b->pre_copied);
+  const Choices &choices = *ident.choices;
+  cpu_check::StageTimer timer(&stage_histograms_);
+
+  // Re-verify buffer copy. A previous check that decrypted the copy in place
+  // verified it first, so for this one it's just made again.
+  std::string syndrome =
+      b->copied_decrypted
+          ? b->copied->CopyFrom(*b->pre_copied, choices.copy_method)
+          : b->copied->Syndrome(*b->pre_copied);
+  b->copied_decrypted = false;
   if (!syndrome.empty()) {
-    return ReturnError("copy", absl::StrCat(JsonRecord("syndrome", syndrome),
-                                            ", ", writer_reader_ident));
+    return ReturnError(cpu_check::kStageCopyVerify, "copy",
+                       absl::StrCat(JsonRecord("syndrome", syndrome), ", ",
+                                    Ident(ident)));
   }
 
   MaybeFlush(*b->copied);
   MalignBuffer *head = b->copied.get();
+  timer.Lap(cpu_check::kStageCopyVerify);
 
   if (do_encrypt) {
     // Decrypt.
-    if (!b->decrypted) b->Alloc(&b->decrypted);
-    b->decrypted->Initialize(Alignment(), head->size());
-    MaybeFlush(*b->decrypted);
+    MalignBuffer *decrypted = head;
+    if (choices.decrypt_in_place) {
+      b->copied_decrypted = true;
+    } else {
+      std::unique_ptr<MalignBuffer> &scratch = *b->OtherScratch(head);
+      b->Alloc(&scratch, head->size(), BufferNodes(ident, true));
+      scratch->Initialize(Alignment(), head->size());
+      MaybeFlush(*scratch);
+      if (choices.madvise) scratch->MadviseDontNeed();
+      decrypted = scratch.get();
+    }
 
-    if (choices.madvise) b->decrypted->MadviseDontNeed();
-    auto s = cpu_check::Crypto::Decrypt(*head, checksums.crypto_purse,
-                                        b->decrypted.get());
+    auto s = crypto_.Decrypt(*head, checksums.crypto_purse, decrypted);
     if (!s.ok()) {
-      return ReturnError(s.message(), writer_reader_ident);
+      return ReturnError(cpu_check::kStageDecrypt, s.message(),
+                         Ident(ident));
     }
 
-    MaybeFlush(*b->decrypted);
-    head = b->decrypted.get();
-    syndrome = b->pre_encrypted->Syndrome(*head);
+    MaybeFlush(*decrypted);
+    head = decrypted;
+    // Without the plain text, decompression and the pattern comparison
+    // check decryption.
+    if (b->pre_encrypted) syndrome = b->pre_encrypted->Syndrome(*head);
     if (!syndrome.empty()) {
-      return ReturnError("decryption_mismatch",
+      return ReturnError(cpu_check::kStageDecrypt, "decryption_mismatch",
                          absl::StrCat(JsonRecord("syndrome", syndrome), ", ",
-                                      writer_reader_ident));
+                                      Ident(ident)));
     }
+    timer.Lap(cpu_check::kStageDecrypt);
   }
 
   if (do_compress) {
-    // Run decompressor.
-    if (!b->decompressed) b->Alloc(&b->decompressed);
-    b->decompressed->Initialize(Alignment(), choices.buf_size);
-    MaybeFlush(*b->decompressed);
-
-    if (choices.madvise) b->decompressed->MadviseDontNeed();
-    const auto s = zlib_.Decompress(*head, b->decompressed.get());
+    // Run decompressor, perhaps another implementation of the format.
+    std::unique_ptr<MalignBuffer> &decompressed = *b->OtherScratch(head);
+    b->Alloc(&decompressed, choices.buf_size, BufferNodes(ident, true));
+    decompressed->Initialize(Alignment(), choices.buf_size);
+    MaybeFlush(*decompressed);
+
+    if (choices.madvise) decompressed->MadviseDontNeed();
+    const auto s = compressors_.compressor(choices.decompressor)
+                       .Decompress(*head, decompressed.get());
     if (!s.ok()) {
-      return ReturnError("uncompression",
+      if (absl::IsFailedPrecondition(s)) return s;
+      return ReturnError(cpu_check::kStageDecompress, "uncompression",
                          absl::StrCat(Json("syndrome", s.message()), ", ",
-                                      writer_reader_ident));
+                                      Ident(ident)));
     }
-    if (b->decompressed->size() != choices.buf_size) {
+    if (decompressed->size() != choices.buf_size) {
       std::stringstream ss;
-      ss << "dec_length: " << b->decompressed->size()
+      ss << "dec_length: " << decompressed->size()
          << " vs: " << choices.buf_size;
       return ReturnError(
-          "decompressed_size",
-          absl::StrCat(Json("syndrome", ss.str()), ", ", writer_reader_ident));
+          cpu_check::kStageDecompress, "decompressed_size",
+          absl::StrCat(Json("syndrome", ss.str()), ", ", Ident(ident)));
     }
-    MaybeFlush(*b->decompressed);
-    head = b->decompressed.get();
+    MaybeFlush(*decompressed);
+    head = decompressed.get();
+    timer.Lap(cpu_check::kStageDecompress);
   }
 
-  if (!b->re_made) b->Alloc(&b->re_made);
-  b->re_made->Initialize(Alignment(), choices.buf_size);
-  const cpu_check::FloatingPointResults f_r = pattern_generators_.Generate(
-      *choices.pattern_generator, choices.hole, round_, choices.copy_method,
-      choices.use_repstos, choices.exercise_floating_point, b->re_made.get());
-  syndrome = b->original->Syndrome(*b->re_made);
+  // Re-make the pattern a cache-resident piece at a time, comparing each
+  // piece with the original as soon as it's made.
+  if (!re_make_piece_) {
+    re_make_piece_.reset(new MalignBuffer(kReMakePiece));
+    buffer_bytes_ += kReMakePiece;
+  }
+  re_make_piece_->Initialize(Alignment(), kReMakePiece);
+  const cpu_check::FloatingPointResults f_r = pattern_generators_.Stream(
+      *choices.pattern_generator, choices.hole, choices.round,
+      choices.copy_method, choices.use_repstos, choices.exercise_floating_point,
+      choices.buf_size, re_make_piece_.get(),
+      [&](size_t offset, const MalignBuffer &piece) {
+        if (syndrome.empty()) syndrome = b->original->Syndrome(offset, piece);
+      });
 
   if (!syndrome.empty()) {
-    return ReturnError("re-make", absl::StrCat(JsonRecord("syndrome", syndrome),
-                                               ", ", writer_reader_ident));
+    return ReturnError(cpu_check::kStageReMake, "re-make",
+                       absl::StrCat(JsonRecord("syndrome", syndrome), ", ",
+                                    Ident(ident)));
   }
 
   if (checksums.floating_point_results != f_r) {
     std::stringstream ss;
     ss << "Was: " << checksums.floating_point_results.d << " Is: " << f_r.d;
-    return ReturnError("fp-double", absl::StrCat(Json("syndrome", ss.str()),
-                                                 ", ", writer_reader_ident));
+    return ReturnError(cpu_check::kStageReMake, "fp-double",
+                       absl::StrCat(Json("syndrome", ss.str()), ", ",
+                                    Ident(ident)));
   }
+  timer.Lap(cpu_check::kStageReMake);
 
   if (do_hashes) {
-    // Re-run hash func.
-    const std::string hash = choices.hasher->Hash(*head);
+    // Re-run hash func, with the checker's instruction set.
+    const std::string hash =
+        choices.hasher->HashWith(*head, choices.check_isa);
     if (checksums.hash_value != hash) {
       std::stringstream ss;
       ss << "hash was: " << checksums.hash_value << " is: " << hash;
-      return ReturnError("hash", absl::StrCat(Json("syndrome", ss.str()), ", ",
-                                              writer_reader_ident));
+      return ReturnError(cpu_check::kStageRehash, "hash",
+                         absl::StrCat(Json("syndrome", ss.str()), ", ",
+                                      Ident(ident)));
     }
+    timer.Lap(cpu_check::kStageRehash);
   }
 
-  auto s = silkscreen_->CheckMySlots(tid_, round_);
-  if (!s.ok()) {
-    return ReturnError("Silkscreen",
-                       absl::StrCat(s.message(), ", ", writer_reader_ident));
+  if (!do_pipeline) {
+    // In pipelined mode the writer checks its own slots, see DoComputations.
+    auto s = silkscreen_->CheckMySlots(tid_, choices.round);
+    if (!s.ok()) {
+      return ReturnError(cpu_check::kStageSilkscreenCheck, "Silkscreen",
+                         absl::StrCat(s.message(), ", ", Ident(ident)));
+    }
+    timer.Lap(cpu_check::kStageSilkscreenCheck);
   }
   return absl::OkStatus();
 }
@@ -650,11 +993,8 @@ std::vector<int> Worker::CheckerTids() {
   if (!do_hop) {
     return std::vector<int>(kCheckers, tid_);
   }
-  std::vector<int> candidates;
-  for (int i : tid_list_) {
-    if (i != tid_) candidates.push_back(i);
-  }
-  std::shuffle(candidates.begin(), candidates.end(), rndeng_);
+  const std::vector<int> candidates =
+      topology.OrderCheckers(checker_policy, tid_, *tids_->Get(), &rndeng_);
   std::vector<int> v;
   v.reserve(kCheckers);
   for (int i = 0; i < kCheckers; i++) {
@@ -663,6 +1003,136 @@ std::vector<int> Worker::CheckerTids() {
   return v;
 }
 
+std::string Worker::TidJson(int tid) const {
+  return "{ " + Json("tid", tid) +
+         (fvt_controller_ != nullptr ? ", " + FVT() : "") + " }";
+}
+
+void Worker::ReportChecks(const std::vector<int> &failing_tids) {
+  if (!failing_tids.empty()) {
+    // Guess which LPU is the most likely culprit. The guess is pretty good
+    // for low failure rate LPUs that haven't corrupted crucial common state.
+    if (failing_tids.size() > 1) {
+      // Both checkers think the computation was wrong, likely culprit is the
+      // writer.
+      ReportSuspect(tid_);
+    } else {
+      // Only one checker thinks the computation was wrong. Likely he's the
+      // culprit since the other checker and the writer agree.
+      ReportSuspect(failing_tids[0]);
+    }
+    return;
+  }
+  counters_.AddSuccess();
+}
+
+std::unique_ptr<Worker::BufferSet> Worker::ReclaimBufferSet() {
+  while (!stopper_->Expired()) {
+    std::unique_ptr<Handoff> h;
+    if (returns_.Pop(&h)) {
+      in_flight_--;
+      if (h->checked) ReportChecks(h->failing_tids);
+      return std::move(h->buffers);
+    }
+    if (in_flight_ < kPipelineDepth) {
+      return std::make_unique<BufferSet>(&buffer_bytes_);
+    }
+    usleep(kPollMicros);
+  }
+  return nullptr;
+}
+
+void Worker::DrainReturns() {
+  const double deadline = TimeInSeconds() + kDrainSeconds;
+  while (in_flight_ > 0 && TimeInSeconds() < deadline) {
+    std::unique_ptr<Handoff> h;
+    if (!returns_.Pop(&h)) {
+      usleep(kPollMicros);
+      continue;
+    }
+    in_flight_--;
+    if (h->checked) ReportChecks(h->failing_tids);
+  }
+}
+
+bool Worker::Forward(std::unique_ptr<Handoff> h) {
+  Worker *const writer = h->writer;
+  if (h->next_checker >= h->choices.checker_tids.size()) {
+    // Only the writer consumes its returns, and it has at most
+    // kPipelineDepth rounds out, so this can't overflow.
+    return writer->returns_.Push(std::move(h));
+  }
+  const int checker_tid = h->choices.checker_tids[h->next_checker];
+  Worker *const checker =
+      (*writer->checkers_)[checker_tid].load(std::memory_order_acquire);
+  h->t_sent = cpu_check::Ticks();
+  while (!checker->inbox_.Push(std::move(h))) {
+    if (writer->stopper_->Expired()) return false;
+    usleep(kPollMicros);
+  }
+  return true;
+}
+
+void Worker::Check(std::unique_ptr<Handoff> h) {
+  stage_histograms_.Add(cpu_check::kStageHop, cpu_check::Ticks() - h->t_sent);
+  const RoundIdent ident = {&h->choices, h->writer->tid(), tid_};
+  const absl::Status check_status =
+      CheckComputations(ident, h->checksums, h->buffers.get());
+  if (check_status.ok()) {
+    // It suffices to check just once if the checker confirms that
+    // computation was correct.
+    h->next_checker = h->choices.checker_tids.size();
+  } else if (absl::IsFailedPrecondition(check_status)) {
+    // The check couldn't be set up, so there's no verdict. Return the round
+    // unchecked.
+    LOG(WARN) << check_status.message();
+    h->next_checker = h->choices.checker_tids.size();
+    Forward(std::move(h));
+    return;
+  } else {
+    h->failing_tids.push_back(tid_);
+    LOG(ERROR) << check_status.message();
+    h->next_checker++;
+  }
+  // The writer reports the verdict once the round is back.
+  h->checked = h->next_checker >= h->choices.checker_tids.size();
+  Forward(std::move(h));
+}
+
+void Worker::RunChecker() {
+  bool pinned = false;
+  while (!stopper_->Expired()) {
+    if (parked_) {
+      // Our CPU is no longer under test. Return anything sent before the
+      // writers noticed, without a verdict.
+      pinned = false;
+      std::unique_ptr<Handoff> h;
+      if (!inbox_.Pop(&h)) {
+        SleepForMillis(10);
+        continue;
+      }
+      h->next_checker = h->choices.checker_tids.size();
+      Forward(std::move(h));
+      continue;
+    }
+    if (!pinned && std::thread::hardware_concurrency() > 1) {
+      if (!SetAffinity(tid_)) {
+        LOG(WARN) << "Couldnt run checker on " << tid_ << " sleeping a bit";
+        stopper_->BoundedSleep(30);
+        continue;
+      }
+    }
+    pinned = true;
+    std::unique_ptr<Handoff> h;
+    if (!inbox_.Pop(&h)) {
+      usleep(kPollMicros);
+      continue;
+    }
+    Check(std::move(h));
+  }
+  LOG(INFO) << "checker tid " << tid_ << " exiting.";
+}
+
 void Worker::Run() {
   const double t0 = TimeInSeconds();
 
@@ -678,9 +1148,13 @@ void Worker::Run() {
   // MalignBuffers are allocated once if !do_madvise. Otherwise they are
   // reallocated each iteration of the main loop, creating much more memory
   // allocator work, which may itself exhibit, and suffer from, CPU defects.
-  std::unique_ptr<BufferSet> b = std::make_unique<BufferSet>();
+  std::unique_ptr<BufferSet> b = std::make_unique<BufferSet>(&buffer_bytes_);
 
   while (!stopper_->Expired()) {
+    if (parked_) {
+      stopper_->BoundedSleep(1);
+      continue;
+    }
     if (std::thread::hardware_concurrency() > 1) {
       if (!SetAffinity(tid_)) {
         LOG(WARN) << "Couldnt run on " << tid_ << " sleeping a bit";
@@ -688,11 +1162,17 @@ void Worker::Run() {
         continue;
       }
     }
+    if (do_pipeline && !b) {
+      // Our last BufferSet went off to the checkers.
+      b = ReclaimBufferSet();
+      if (!b) break;
+    }
     round_++;
+    counters_.AddRound();
 
     if (do_madvise) {
       // Release and reallocate MalignBuffers.
-      b.reset(new BufferSet);
+      b.reset(new BufferSet(&buffer_bytes_));
     }
 
     if (do_noise) {
@@ -705,87 +1185,261 @@ void Worker::Run() {
       fvt_controller_->MonitorFrequency();
     }
 
-    auto Turbo = [&turbo_mhz]() { return Json("turbo", turbo_mhz); };
-
-    auto Tid = [this](int tid) {
-      return "{ " + Json("tid", tid) + (do_fvt ? ", " + FVT() : "") + " }";
-    };
-
-    auto Writer = [this, Tid]() { return "\"writer\": " + Tid(tid_); };
-
     LOG_EVERY_N_SECS(INFO, 30) << Jstat(
         Json("elapsed_s", static_cast<uint64_t>(TimeInSeconds() - t0)) + ", " +
-        Json("failures", errorCount.load()) + ", " +
-        Json("successes", successCount.load()) + ", " + Writer() +
+        Json("failures", counters_.failures()) + ", " +
+        Json("successes", counters_.successes()) + ", \"writer\": " +
+        TidJson(tid_) +
         (fvt_controller_ != nullptr
              ? ", " + Json("meanFreq", fvt_controller_->GetMeanFreqMhz()) +
                    ", " + Json("maxFreq", fvt_controller_->max_mHz())
              : ""));
 
-    const Choices choices = MakeChoices(b.get());
-    const std::string writer_ident =
-        absl::StrCat(Writer(), ", ", Turbo(), ", ", choices.summary);
+    Choices choices = MakeChoices(b.get());
+    choices.turbo_mhz = turbo_mhz;
 
-    auto s = DoComputations(writer_ident, choices, b.get());
+    auto s = DoComputations({&choices, tid_}, b.get());
     if (!s.ok()) {
       LOG(ERROR) << s.status().message();
-      LOG(ERROR) << Suspect(tid_);
-      errorCount++;
+      if (!absl::IsFailedPrecondition(s.status())) ReportSuspect(tid_);
       continue;
     }
     const Checksums checksums = s.value();
 
+    if (do_pipeline) {
+      // Hand the round off to its checkers and get on with the next one.
+      auto h = std::make_unique<Handoff>();
+      h->writer = this;
+      h->buffers = std::move(b);
+      h->choices = std::move(choices);
+      h->checksums = checksums;
+      in_flight_++;
+      Forward(std::move(h));
+      continue;
+    }
+
     // Check the computation. Twice if the first check fails.
-    const std::vector<int> checker_tids = CheckerTids();
     std::vector<int> failing_tids;
-    for (int c : checker_tids) {
+    bool checked = true;
+    for (int c : choices.checker_tids) {
       int newcpu = c;
+      const uint64_t t_hop = cpu_check::Ticks();
       if (!SetAffinity(newcpu)) {
         // Tough luck, can't run on chosen CPU.
         // Validate on same cpu we were on.
         newcpu = tid_;
       }
-
-      auto Reader = [&Tid, &newcpu]() { return "\"reader\": " + Tid(newcpu); };
-      const std::string writer_reader_ident = absl::StrCat(
-          Writer(), ", ", Reader(), ", ", Turbo(), ", ", choices.summary);
+      stage_histograms_.Add(cpu_check::kStageHop, cpu_check::Ticks() - t_hop);
 
       const absl::Status check_status =
-          CheckComputations(writer_reader_ident, choices, checksums, b.get());
+          CheckComputations({&choices, tid_, newcpu}, checksums, b.get());
       if (check_status.ok()) {
         // It suffices to check just once if the checker confirms that
         // computation was correct.
         break;
+      } else if (absl::IsFailedPrecondition(check_status)) {
+        // The check couldn't be set up, so there's no verdict.
+        LOG(WARN) << check_status.message();
+        checked = false;
+        break;
       } else {
         failing_tids.push_back(newcpu);
         LOG(ERROR) << check_status.message();
-        errorCount++;
       }
     }
-    if (!failing_tids.empty()) {
-      // Guess which LPU is the most likely culprit. The guess is pretty good
-      // for low failure rate LPUs that haven't corrupted crucial common state.
-      if (failing_tids.size() > 1) {
-        // Both checkers think the computation was wrong, likely culprit is the
-        // writer.
-        LOG(ERROR) << Suspect(tid_);
-      } else {
-        // Only one checker thinks the computation was wrong. Likely he's the
-        // culprit since the other checker and the writer agree.
-        LOG(ERROR) << Suspect(failing_tids[0]);
-      }
-      continue;
-    }
-    successCount++;
+    if (checked) ReportChecks(failing_tids);
   }
+  if (do_pipeline) DrainReturns();
   LOG(INFO) << "tid " << tid_ << " exiting.";
 }
 
+// Runs a writer Worker on each tid of a TidList, plus a checker Worker if
+// 'do_pipeline'. Workers are started as their tids join the list, and parked
+// while their tids are out of it; they are only destroyed with the pool.
+class WorkerPool {
+ public:
+  // Does not take ownership.
+  WorkerPool(TidList *tids, cpu_check::Silkscreen *silkscreen,
+             Stopper *stopper)
+      : tids_(tids),
+        silkscreen_(silkscreen),
+        stopper_(stopper),
+        writers_(tids->limit()),
+        checkers_(tids->limit()) {}
+
+  ~WorkerPool();
+
+  // Waits for all Workers to exit.
+  void Join();
+
+  // Makes 'tids' the tids under test, starting or resuming their Workers,
+  // and parking those of tids no longer listed.
+  void Update(const std::vector<int> &tids);
+
+  // Emits a stat record of buffer footprint and per-stage round latencies
+  // for each Worker, and one for all Workers combined.
+  void LogWorkerStats() const;
+
+  // Accumulates all Workers' RoundCounters into '*total'.
+  void SumCounters(cpu_check::RoundCounters *total) const;
+
+  // Emits a stat record per tid of its Workers' RoundCounters, suspect
+  // count, and rate of rounds since the last call or, if 'whole_run', since
+  // the pool started.
+  void LogCpuCounters(bool whole_run);
+
+ private:
+  // Accumulates the RoundCounters of 'tid's Workers into '*c'.
+  void SumTidCounters(int tid, cpu_check::RoundCounters *c) const;
+
+  TidList *const tids_;
+  cpu_check::Silkscreen *const silkscreen_;
+  Stopper *const stopper_;
+  // Indexed by tid. Checkers are nullptr until first needed.
+  std::vector<std::vector<Worker *>> writers_;
+  std::vector<std::atomic<Worker *>> checkers_;
+  std::vector<std::thread *> threads_;
+  const double start_time_ = TimeInSeconds();
+  // As of the last LogCpuCounters.
+  std::vector<uint64_t> last_rounds_ = std::vector<uint64_t>(tids_->limit());
+  double last_time_ = start_time_;
+};
+
+WorkerPool::~WorkerPool() {
+  Join();
+  // Checkers first, since rounds queued for them hold writers' buffers.
+  for (auto &w : checkers_) {
+    delete w.load();
+  }
+  for (auto &v : writers_) {
+    for (auto w : v) delete w;
+  }
+}
+
+void WorkerPool::Join() {
+  for (auto &t : threads_) {
+    t->join();
+    delete t;
+  }
+  threads_.clear();
+}
+
+void WorkerPool::Update(const std::vector<int> &tids) {
+  for (int tid = 0; tid < tids_->limit(); tid++) {
+    // A tid listed more than once gets as many writers.
+    const size_t n = std::count(tids.begin(), tids.end(), tid);
+    if (n > 0 && do_pipeline && checkers_[tid].load() == nullptr) {
+      // Publish the checker before any writer can choose it.
+      Worker *c = new Worker(getpid(), tids_, tid, silkscreen_, stopper_);
+      checkers_[tid].store(c, std::memory_order_release);
+      threads_.push_back(new std::thread(&Worker::RunChecker, c));
+    }
+    while (writers_[tid].size() < n) {
+      Worker *w = new Worker(getpid(), tids_, tid, silkscreen_, stopper_);
+      if (do_pipeline) w->set_checkers(&checkers_);
+      writers_[tid].push_back(w);
+      threads_.push_back(new std::thread(&Worker::Run, w));
+    }
+    for (size_t i = 0; i < writers_[tid].size(); i++) {
+      writers_[tid][i]->set_parked(i >= n);
+    }
+    // Resume checkers before listing them, park them after unlisting.
+    if (n > 0) {
+      if (Worker *c = checkers_[tid].load()) c->set_parked(false);
+    }
+  }
+  tids_->Set(tids);
+  for (int tid = 0; tid < tids_->limit(); tid++) {
+    if (std::find(tids.begin(), tids.end(), tid) != tids.end()) continue;
+    if (Worker *c = checkers_[tid].load()) c->set_parked(true);
+  }
+}
+
+void WorkerPool::LogWorkerStats() const {
+  cpu_check::StageHistograms all;
+  uint64_t buffer_bytes = 0;
+  uint64_t max_buffer_bytes = 0;
+  auto LogWorker = [&](const Worker *w, absl::string_view role) {
+    cpu_check::StageHistograms h;
+    h.MergeFrom(w->stage_histograms());
+    all.MergeFrom(h);
+    const uint64_t bytes = w->buffer_bytes();
+    buffer_bytes += bytes;
+    max_buffer_bytes = std::max(max_buffer_bytes, bytes);
+    LOG(INFO) << Jstat(Json("tid", w->tid()) + ", " + Json("role", role) +
+                       ", " + Json("bufferBytes", bytes) + ", " +
+                       JsonRecord("stages", h.Json()));
+  };
+  for (const auto &v : writers_) {
+    for (const Worker *w : v) LogWorker(w, "writer");
+  }
+  for (const auto &c : checkers_) {
+    if (const Worker *w = c.load()) LogWorker(w, "checker");
+  }
+  LOG(INFO) << Jstat(Json("tid", "all") + ", " +
+                     Json("ticksPerUs", cpu_check::TicksPerMicrosecond()) +
+                     ", " + Json("bufferBytes", buffer_bytes) + ", " +
+                     Json("maxBufferBytes", max_buffer_bytes) + ", " +
+                     JsonRecord("stages", all.Json()));
+}
+
+void WorkerPool::SumTidCounters(int tid, cpu_check::RoundCounters *c) const {
+  for (const Worker *w : writers_[tid]) c->MergeFrom(w->counters());
+  if (const Worker *w = checkers_[tid].load()) c->MergeFrom(w->counters());
+}
+
+void WorkerPool::SumCounters(cpu_check::RoundCounters *total) const {
+  for (int tid = 0; tid < tids_->limit(); tid++) SumTidCounters(tid, total);
+}
+
+void WorkerPool::LogCpuCounters(bool whole_run) {
+  const double now = TimeInSeconds();
+  for (int tid = 0; tid < tids_->limit(); tid++) {
+    if (writers_[tid].empty()) continue;
+    cpu_check::RoundCounters c;
+    SumTidCounters(tid, &c);
+    const double rate =
+        whole_run ? c.rounds() / (now - start_time_)
+                  : (c.rounds() - last_rounds_[tid]) / (now - last_time_);
+    last_rounds_[tid] = c.rounds();
+    LOG(INFO) << Jstat(Json("tid", tid) + ", " + c.Json() + ", " +
+                       Json("roundsPerSec", rate) + ", " +
+                       Json("suspects", suspect_counts[tid].load()));
+  }
+  last_time_ = now;
+}
+
+// Returns the tids to test: those this process may run on, less
+// 'explicit_tids' if 'do_invert_cores', or else 'explicit_tids' if given.
+static std::vector<int> TidsToTest(const std::vector<int> &explicit_tids) {
+  if (!explicit_tids.empty() && !do_invert_cores) return explicit_tids;
+  std::vector<int> allowed = cpu_check::AllowedCpus();
+  if (allowed.empty()) {
+    const int n = std::thread::hardware_concurrency();
+    for (int i = 0; i < n; i++) {
+      allowed.push_back(i);
+    }
+  }
+  if (!do_invert_cores) return allowed;
+  // Complement the tid_list in -N mode.
+  std::vector<int> v;
+  for (int i : allowed) {
+    if (std::find(explicit_tids.begin(), explicit_tids.end(), i) ==
+        explicit_tids.end()) {
+      v.push_back(i);
+    }
+  }
+  return v;
+}
+
 static void UsageIf(bool v) {
   if (!v) return;
-  LOG(ERROR) << "Usage cpu_check [-a] [-b] [-c] [-d] [-e] [-F] [-h]"
-             << " [-m] [-nN] [-p] [-qNNN] [-r] [-x] [-X] [-s] [-Y] [-H] [-kXXX]"
+  LOG(ERROR) << "Usage cpu_check [-A] [-a] [-b] [-c] [-d] [-e] [-F] [-h]"
+             << " [-m] [-Mplacement] [-nN] [-o] [-p] [-Ppolicy] [-qNNN] [-r]"
+             << " [-x] [-X] [-s]"
+             << " [-Y] [-H] [-kXXX]"
              << " [-z] [-cn,n,...,n] [-fMinF[-MaxF]] [-tNNN] [-u]"
+             << "\n  A: Compute all hashes every round, in one pass"
              << "\n  a: Do not misalign"
              << "\n  b: Do not run BoringSSL self check"
              << "\n  c: Explicit list of CPUs"
@@ -797,9 +1451,17 @@ static void UsageIf(bool v) {
              << "\n  h: Do not hash"
              << "\n  m: Do not madvise, do not malloc per iteration"
              << "\n  l: Do not provoke heavy AVX power fluctuations"
+             << "\n  M: Buffer NUMA placement: touch (default, first touch),"
+             << "\n     writer, checker (checker's node for its buffers),"
+             << "\n     interleave, remote (not the writer's node)"
              << "\n  n: Generate noise"
              << "\n  N: Generate noise, invert -c"
+             << "\n  o: Overlap writing and checking: check on pinned per-CPU"
+             << "\n     checker threads instead of switching CPUs"
              << "\n  p: Corrupt data provenance"
+             << "\n  P: Checker CPU policy: any (default), smt (SMT sibling),"
+             << "\n     l3 (other core sharing L3), remote (other socket),"
+             << "\n     node (other NUMA node)"
              << "\n  q: Quit if more than N errors"
              << "\n  r: Do not repmovsb"
              << "\n  t: Timeout in seconds"
@@ -821,6 +1483,8 @@ int main(int argc, char **argv) {
   // Initialize the symbolizer to get a human-readable stack trace.
   absl::InitializeSymbolizer(argv[0]);
   absl::FailureSignalHandlerOptions options;
+  // Lines still queued may say what led to the failure.
+  options.writerfn = LogFailureWriter;
   absl::InstallFailureSignalHandler(options);
 
   for (int i = 1; i < argc; i++) {
@@ -828,6 +1492,9 @@ int main(int argc, char **argv) {
     UsageIf(flag[0] != '-');
     for (flag++; *flag != 0; flag++) {
       switch (*flag) {
+        case 'A':
+          do_all_hashes = true;
+          break;
         case 'a':
           do_misalign = false;
           break;
@@ -893,12 +1560,25 @@ int main(int argc, char **argv) {
           do_madvise = false;
           do_hop = false;
           break;
+        case 'o':
+          do_pipeline = true;
+          break;
         case 'p':
           do_provenance = true;
           do_encrypt = false;
           do_hashes = false;
           do_compress = false;
           break;
+        case 'P': {
+          std::string c(++flag);
+          flag += c.length();
+          UsageIf(!cpu_check::ParseCheckerPolicy(c, &checker_policy));
+        } break;
+        case 'M': {
+          std::string c(++flag);
+          flag += c.length();
+          UsageIf(!cpu_check::ParseBufferPlacement(c, &buffer_placement));
+        } break;
         case 'q': {
           std::string c(++flag);
           flag += c.length();
@@ -951,6 +1631,7 @@ int main(int argc, char **argv) {
             << (!do_flush ? "" : " Cache-line flush ")
             << (do_encrypt ? "" : " No encryption ")
             << (do_hashes ? "" : " No hash ")
+            << (do_all_hashes ? " All hashes " : "")
             << (do_madvise ? "" : " No madvise ")
             << (do_provenance ? " Provenance " : "")
             << (do_repmovsb ? "" : " No repmovsb ")
@@ -960,6 +1641,9 @@ int main(int argc, char **argv) {
             << (do_avx_heavy ? " AVX_heavy " : "")
             << (do_compress ? "" : " No compression ")
             << (do_hop ? "" : " No thread_switch ")
+            << (do_pipeline ? " Pipelined " : "")
+            << " Checkers: " << cpu_check::ToString(checker_policy)
+            << " Buffers: " << cpu_check::ToString(buffer_placement)
             << (do_ssl_self_check ? "" : " No BoringSSL self check")
             << (!do_freq_sweep ? "" : " FrequencySweep ")
             << (!do_freq_hi_lo ? "" : " FreqHiLo ")
@@ -968,86 +1652,149 @@ int main(int argc, char **argv) {
 
   if (do_hashes) {
     if (crc32c_selfcheck() != 0) {
-      LOG(WARN) << "CRC32C hardware path failed self-check; using software";
+      LOG(WARN) << "CRC32C failed self-check; falling back to software";
     }
     LOG(INFO) << "CRC32C implementation: " << crc32c_impl_name();
   }
-
-  std::vector<std::thread *> threads;
-  std::vector<Worker *> workers;
+  LOG(INFO) << "Pattern RNG implementation: " << cpu_check::CounterRng::Impl();
+  LOG(INFO) << "Hash implementations: SHA lanes " << cpu_check::ShaLanes::Impl()
+            << ", XXH3 " << cpu_check::Xxh3::Impl() << ", HighwayHash "
+            << cpu_check::HighwayHash::Impl() << ", BLAKE3 "
+            << cpu_check::Blake3::Impl();
+  LOG(INFO) << "Compressors: " << cpu_check::Compressors().Names();
 
   int cpus = std::thread::hardware_concurrency();
   LOG(INFO) << "Detected hardware concurrency: " << cpus;
 
-  if (do_invert_cores) {
-    // Clumsily complement the tid_list in -N mode.
-    std::vector<int> v;
-    for (int i = 0; i < cpus; i++) {
-      if (std::find(tid_list.begin(), tid_list.end(), i) == tid_list.end()) {
-        v.push_back(i);
-      }
-    }
-    tid_list = v;
+  topology = cpu_check::CpuTopology::FromSysfs();
+  LOG(INFO) << Jstat(JsonRecord("topology", topology.Summary()));
+  if (checker_policy != cpu_check::kCheckAnywhere && topology.empty()) {
+    LOG(WARN) << "No CPU topology found, checker policy has no effect";
+  }
+  if (buffer_placement != cpu_check::kPlaceFirstTouch &&
+      topology.Nodes().size() < 2) {
+    LOG(WARN) << "Fewer than two NUMA nodes, buffer placement has no effect";
   }
 
+  // Unless the CPUs are listed explicitly, follow them as they change.
+  const bool dynamic_tids = tid_list.empty() || do_invert_cores;
+  for (int t : tid_list) {
+    LOG(INFO) << "Explicitly " << (do_invert_cores ? "not " : "")
+              << "testing cpu: " << t;
+  }
+  const std::vector<int> explicit_tids = tid_list;
+  tid_list = TidsToTest(explicit_tids);
   if (tid_list.empty()) {
-    for (int i = 0; i < cpus; i++) {
-      tid_list.push_back(i);
-    }
-  } else {
-    for (int t : tid_list) {
-      LOG(INFO) << "Explicitly testing cpu: " << t;
+    LOG(ERROR) << "No CPUs to test";
+    exit(2);
+  }
+  LOG(INFO) << "Testing cpus: " << absl::StrJoin(tid_list, ",");
+
+  // Any CPU that may come online later gets its share of the Silkscreen.
+  std::vector<int> universe = tid_list;
+  if (dynamic_tids) {
+    for (int i : cpu_check::PossibleCpus()) {
+      if (std::find(universe.begin(), universe.end(), i) == universe.end()) {
+        universe.push_back(i);
+      }
     }
   }
+  const int tid_limit = *std::max_element(universe.begin(), universe.end()) + 1;
 
   const double t0 = TimeInSeconds();
 
   // Silkscreen instance shared by all threads.
-  cpu_check::Silkscreen silkscreen(tid_list);
+  cpu_check::Silkscreen silkscreen(universe);
 
   static Stopper stopper(timeout);  // Shared by all threads
 
-  for (int tid : tid_list) {
-    workers.push_back(
-        new Worker(getpid(), tid_list, tid, &silkscreen, &stopper));
-    threads.push_back(new std::thread(&Worker::Run, workers.back()));
-  }
+  suspect_counts = std::vector<std::atomic<uint64_t>>(tid_limit);
+  TidList tids(tid_list, tid_limit);
+  WorkerPool pool(&tids, &silkscreen, &stopper);
+  pool.Update(tid_list);
 
   signal(SIGTERM, [](int) { stopper.Stop(); });
   signal(SIGINT, [](int) { stopper.Stop(); });
 
+  // How often to look for changes to the CPUs we may run on, and to log
+  // stats.
+  constexpr int kRescanSeconds = 5;
+  constexpr int kStatsSeconds = 60;
   struct timeval last_cpu = {0, 0};
   double last_time = t0;
+  double last_rescan = t0;
+  std::set<int> unknown_topology;  // CPUs warned of
   while (!stopper.Expired()) {
-    stopper.BoundedSleep(60);
-    struct rusage ru;
+    stopper.BoundedSleep(1);
     double secs = TimeInSeconds();
-    double secondsPerError = (secs - t0) / errorCount.load();
+    cpu_check::RoundCounters total;
+    pool.SumCounters(&total);
+    if (total.failures() > error_limit) {
+      LOG(INFO) << "I am quitting after " << total.failures() << " errors";
+      stopper.Stop();
+    }
+    if (dynamic_tids && secs - last_rescan >= kRescanSeconds) {
+      last_rescan = secs;
+      // Workers and their bookkeeping are indexed by tid, below the limit
+      // set at startup.
+      std::vector<int> v;
+      std::vector<int> beyond;
+      for (int t : TidsToTest(explicit_tids)) {
+        (t < tids.limit() ? v : beyond).push_back(t);
+      }
+      if (!beyond.empty()) {
+        LOG_EVERY_N_SECS(WARN, 300)
+            << "Not testing cpus beyond those possible at startup: "
+            << absl::StrJoin(beyond, ",");
+      }
+      if (!v.empty() && v != *tids.Get()) {
+        LOG(INFO) << "CPUs changed, now testing cpus: "
+                  << absl::StrJoin(v, ",");
+        // Topology is read once, at startup, when offline CPUs have none.
+        if (!topology.empty() &&
+            (checker_policy != cpu_check::kCheckAnywhere ||
+             buffer_placement != cpu_check::kPlaceFirstTouch)) {
+          for (int t : v) {
+            if (topology.cpu(t) == nullptr &&
+                unknown_topology.insert(t).second) {
+              LOG(WARN) << "cpu " << t << " has unknown topology, so checker"
+                        << " policy and buffer placement can't be met for it";
+            }
+          }
+        }
+        pool.Update(v);
+      }
+    }
+    if (secs - last_time < kStatsSeconds && !stopper.Expired()) continue;
+    struct rusage ru;
+    double secondsPerError = (secs - t0) / total.failures();
     if (getrusage(RUSAGE_SELF, &ru) == -1) {
       LOG(ERROR) << "getrusage failed: " << strerror(errno);
     } else {
       float cpu = (((ru.ru_utime.tv_sec - last_cpu.tv_sec) * 1000000.0) +
                    (ru.ru_utime.tv_usec - last_cpu.tv_usec)) /
                   1000000.0;
-      LOG(INFO) << "Errors: " << errorCount.load()
-                << " Successes: " << successCount.load() << " CPU "
+      LOG(INFO) << "Errors: " << total.failures()
+                << " Successes: " << total.successes() << " CPU "
                 << cpu / (secs - last_time) << " s/s"
                 << " Seconds Per Error: " << secondsPerError;
       last_cpu = ru.ru_utime;
     }
     last_time = secs;
+    pool.LogWorkerStats();
+    pool.LogCpuCounters(false);
   }
 
   // shutting down.
-  for (auto &t : threads) {
-    t->join();
-    delete t;
-  }
-  for (auto w : workers) {
-    delete w;
-  }
-  LOG(ERROR) << errorCount.load() << " ERRORS, " << successCount.load()
+  pool.Join();
+  pool.LogWorkerStats();
+  pool.LogCpuCounters(true);
+  cpu_check::RoundCounters total;
+  pool.SumCounters(&total);
+  LOG(INFO) << Jstat(Json("tid", "all") + ", " + total.Json() + ", " +
+                     Json("logDropped", LogDropCount()));
+  LOG(ERROR) << total.failures() << " ERRORS, " << total.successes()
              << " SUCCESSES.";
   LOG(INFO) << "Exiting.";
-  exit(errorCount != 0);
+  exit(total.failures() != 0);
 }
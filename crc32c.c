@@ -29,11 +29,18 @@
 /* CRC-32C (iSCSI) polynomial in reversed bit order. */
 #define POLY 0x82f63b78
 
+/* Three-way interleaved streams: long streams for big buffers, short ones
+ * for what's left. */
+#define LONG_STREAM 4096
+#define SHORT_STREAM 256
+
 /* Dispatch state. */
 static pthread_once_t g_crc32c_once = PTHREAD_ONCE_INIT;
 static volatile int g_force_sw = 0;
 static crc32c_impl g_impl = CRC32C_IMPL_SW;
 
+static void crc32c_init(void);
+
 static int cpu_has_hw_crc(void) {
 #if X86_ONLY
   __builtin_cpu_init();
@@ -43,9 +50,109 @@ static int cpu_has_hw_crc(void) {
 #endif
 }
 
-uint32_t crc32c_sw(const char *src, size_t len) {
+static int cpu_has_pclmul(void) {
+#if X86_ONLY
+  __builtin_cpu_init();
+  return cpu_has_hw_crc() && __builtin_cpu_supports("pclmul");
+#else
+  return 0;
+#endif
+}
+
+static int cpu_has_vpclmul(void) {
+#if X86_ONLY
+  __builtin_cpu_init();
+  return cpu_has_pclmul() && __builtin_cpu_supports("avx512f") &&
+         __builtin_cpu_supports("vpclmulqdq");
+#else
+  return 0;
+#endif
+}
+
+/* Polynomials mod POLY are held bit reflected: bit 31 is x^0. */
+
+/* Returns a * b mod POLY. */
+static uint32_t multmodp(uint32_t a, uint32_t b) {
+  uint32_t m = (uint32_t)1 << 31;
+  uint32_t p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+  }
+  return p;
+}
+
+/* Returns x^n mod POLY. */
+static uint32_t xpowmodp(uint64_t n) {
+  uint32_t p = (uint32_t)1 << 31; /* x^0 */
+  uint32_t sq = (uint32_t)1 << 30; /* x^(2^k), from x^1 */
+  for (; n; n >>= 1) {
+    if (n & 1) p = multmodp(sq, p);
+    sq = multmodp(sq, sq);
+  }
+  return p;
+}
+
+/* Carryless multiplication of a reflected 64 bit value by a reflected 32 bit
+ * constant yields a reflected 128 bit product shifted by x^33, so the
+ * constants that move data 'bits' further on are x^(bits - 33), and
+ * x^(bits + 31) for the high order half of a 128 bit value. */
+
+/* Multipliers shifting the three-way streams' CRCs over one and two
+ * streams. */
+static uint64_t g_long_shift[2];
+static uint64_t g_short_shift[2];
+
+/* Multipliers folding a 128 bit value 'bits' further on, low half first. */
+typedef struct {
+  uint64_t k[2];
+} fold_constants;
+static fold_constants g_fold_2048;
+static fold_constants g_fold_1536;
+static fold_constants g_fold_1024;
+static fold_constants g_fold_512;
+static fold_constants g_fold_384;
+static fold_constants g_fold_256;
+static fold_constants g_fold_128;
+
+/* x^(2^k), for shifting a CRC over any number of bits. */
+static uint32_t g_x2n[64];
+/* Multipliers shifting a CRC over 2^k 64 bit words. */
+static uint64_t g_word_shift[58];
+
+static void fold_init(fold_constants *f, uint64_t bits) {
+  f->k[0] = xpowmodp(bits + 31);
+  f->k[1] = xpowmodp(bits - 33);
+}
+
+static void constants_init(void) {
+  g_long_shift[0] = xpowmodp(8 * LONG_STREAM - 33);
+  g_long_shift[1] = xpowmodp(16 * LONG_STREAM - 33);
+  g_short_shift[0] = xpowmodp(8 * SHORT_STREAM - 33);
+  g_short_shift[1] = xpowmodp(16 * SHORT_STREAM - 33);
+  fold_init(&g_fold_2048, 2048);
+  fold_init(&g_fold_1536, 1536);
+  fold_init(&g_fold_1024, 1024);
+  fold_init(&g_fold_512, 512);
+  fold_init(&g_fold_384, 384);
+  fold_init(&g_fold_256, 256);
+  fold_init(&g_fold_128, 128);
+  uint32_t p = (uint32_t)1 << 30; /* x^1 */
+  for (int k = 0; k < 64; k++, p = multmodp(p, p)) g_x2n[k] = p;
+  for (int k = 0; k < 58; k++) {
+    g_word_shift[k] = xpowmodp(((uint64_t)64 << k) - 33);
+  }
+}
+
+/* Bit at a time reference, independent of the tables. */
+static uint32_t crc32c_bitwise_extend(uint32_t crc, const char *src,
+                                      size_t len) {
   const unsigned char *s = (unsigned char *)src;
-  uint32_t h = ~0;
+  uint32_t h = ~crc;
   while (len--) {
     h ^= *s++;
     for (int k = 0; k < 8; k++) h = h & 1 ? (h >> 1) ^ POLY : h >> 1;
@@ -53,11 +160,57 @@ uint32_t crc32c_sw(const char *src, size_t len) {
   return ~h;
 }
 
+uint32_t crc32c_bitwise(const char *src, size_t len) {
+  return crc32c_bitwise_extend(0, src, len);
+}
+
+/* Slicing-by-16 tables: g_table[k][b] is the raw CRC of byte 'b' followed by
+ * 'k' zero bytes. */
+static uint32_t g_table[16][256];
+
+static void table_init(void) {
+  for (int b = 0; b < 256; b++) {
+    uint32_t h = b;
+    for (int k = 0; k < 8; k++) h = h & 1 ? (h >> 1) ^ POLY : h >> 1;
+    g_table[0][b] = h;
+  }
+  for (int k = 1; k < 16; k++) {
+    for (int b = 0; b < 256; b++) {
+      const uint32_t h = g_table[k - 1][b];
+      g_table[k][b] = (h >> 8) ^ g_table[0][h & 0xff];
+    }
+  }
+}
+
+/* Looks up 16 bytes at a time, each in its own table, so the lookups are
+ * independent of one another. */
+static uint32_t crc32c_sw_extend(uint32_t crc, const char *src, size_t len) {
+  const unsigned char *s = (unsigned char *)src;
+  uint32_t h = ~crc;
+  for (; len >= 16; s += 16, len -= 16) {
+    const uint32_t w = h ^ (s[0] | (uint32_t)s[1] << 8 |
+                            (uint32_t)s[2] << 16 | (uint32_t)s[3] << 24);
+    h = g_table[15][w & 0xff] ^ g_table[14][(w >> 8) & 0xff] ^
+        g_table[13][(w >> 16) & 0xff] ^ g_table[12][w >> 24] ^
+        g_table[11][s[4]] ^ g_table[10][s[5]] ^ g_table[9][s[6]] ^
+        g_table[8][s[7]] ^ g_table[7][s[8]] ^ g_table[6][s[9]] ^
+        g_table[5][s[10]] ^ g_table[4][s[11]] ^ g_table[3][s[12]] ^
+        g_table[2][s[13]] ^ g_table[1][s[14]] ^ g_table[0][s[15]];
+  }
+  while (len--) h = (h >> 8) ^ g_table[0][(h ^ *s++) & 0xff];
+  return ~h;
+}
+
+uint32_t crc32c_sw(const char *src, size_t len) {
+  pthread_once(&g_crc32c_once, crc32c_init);
+  return crc32c_sw_extend(0, src, len);
+}
+
 #if X86_ONLY
 __attribute__((target("sse4.2")))
-static uint32_t crc32c_hw_body(const char *src, size_t len) {
+static uint32_t crc32c_hw_extend(uint32_t crc, const char *src, size_t len) {
   const unsigned char *s = (const unsigned char *)src;
-  uint64_t hh = ~0u;
+  uint64_t hh = (uint32_t)~crc;
 #ifdef __x86_64__
   while (len > 7) {
     uint64_t v;
@@ -92,100 +245,340 @@ static uint32_t crc32c_hw_body(const char *src, size_t len) {
   return ~h;
 }
 
+static uint32_t crc32c_hw_body(const char *src, size_t len) {
+  return crc32c_hw_extend(0, src, len);
+}
+
 uint32_t crc32c_hw(const char *src, size_t len) { return crc32c_hw_body(src, len); }
+
+#ifdef __x86_64__
+/* Returns raw CRC 'h' moved on over the number of zero bytes 'k' is for. */
+__attribute__((target("sse4.2,pclmul")))
+static uint64_t crc32c_shift(uint64_t h, uint64_t k) {
+  const __m128i p =
+      _mm_clmulepi64_si128(_mm_cvtsi64_si128(h), _mm_cvtsi64_si128(k), 0);
+  return _mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(p));
+}
+
+/* Runs three independent crc32 chains over consecutive 'n' byte streams,
+ * then joins them, shifting the first over two streams and the second over
+ * one. Returns the raw CRC; 'shift' as g_long_shift. */
+__attribute__((target("sse4.2,pclmul")))
+static uint64_t crc32c_3way(uint64_t h, const unsigned char **src,
+                            size_t *len, size_t n, const uint64_t *shift) {
+  const unsigned char *s = *src;
+  while (*len >= 3 * n) {
+    uint64_t h1 = 0, h2 = 0;
+    for (size_t i = 0; i < n; i += 8) {
+      uint64_t v0, v1, v2;
+      memcpy(&v0, s + i, sizeof(v0));
+      memcpy(&v1, s + n + i, sizeof(v1));
+      memcpy(&v2, s + 2 * n + i, sizeof(v2));
+      h = _mm_crc32_u64(h, v0);
+      h1 = _mm_crc32_u64(h1, v1);
+      h2 = _mm_crc32_u64(h2, v2);
+    }
+    h = crc32c_shift(h, shift[1]) ^ crc32c_shift(h1, shift[0]) ^ h2;
+    s += 3 * n;
+    *len -= 3 * n;
+  }
+  *src = s;
+  return h;
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crc32c_hw3_extend(uint32_t crc, const char *src, size_t len) {
+  const unsigned char *s = (const unsigned char *)src;
+  uint64_t h = (uint32_t)~crc;
+  h = crc32c_3way(h, &s, &len, LONG_STREAM, g_long_shift);
+  h = crc32c_3way(h, &s, &len, SHORT_STREAM, g_short_shift);
+  return crc32c_hw_extend(~(uint32_t)h, (const char *)s, len);
+}
+
+/* Folds 128 bit lanes of 'x' on by the distance 'f' is for, adding 'y'. */
+__attribute__((target("avx512f,vpclmulqdq")))
+static __m512i fold512(__m512i x, const fold_constants *f, __m512i y) {
+  const __m512i k = _mm512_broadcast_i32x4(_mm_loadu_si128((__m128i *)f->k));
+  return _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(x, k, 0x00),
+                                   _mm512_clmulepi64_epi128(x, k, 0x11), y,
+                                   0x96);
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static __m128i fold128(__m128i x, const fold_constants *f, __m128i y) {
+  const __m128i k = _mm_loadu_si128((const __m128i *)f->k);
+  return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+                                     _mm_clmulepi64_si128(x, k, 0x11)),
+                       y);
+}
+
+/* Folds four 512 bit accumulators across the buffer, 256 bytes at a time,
+ * then folds them down to 128 bits, which two crc32 instructions reduce. */
+__attribute__((target("sse4.2,pclmul,avx512f,vpclmulqdq")))
+static uint32_t crc32c_vpclmul_extend(uint32_t crc, const char *src,
+                                      size_t len) {
+  if (len < 256) return crc32c_hw3_extend(crc, src, len);
+  const char *s = src;
+  __m512i x0 = _mm512_loadu_si512(s);
+  __m512i x1 = _mm512_loadu_si512(s + 64);
+  __m512i x2 = _mm512_loadu_si512(s + 128);
+  __m512i x3 = _mm512_loadu_si512(s + 192);
+  x0 = _mm512_xor_si512(x0, _mm512_zextsi128_si512(_mm_cvtsi32_si128(~crc)));
+  s += 256;
+  len -= 256;
+  for (; len >= 256; s += 256, len -= 256) {
+    x0 = fold512(x0, &g_fold_2048, _mm512_loadu_si512(s));
+    x1 = fold512(x1, &g_fold_2048, _mm512_loadu_si512(s + 64));
+    x2 = fold512(x2, &g_fold_2048, _mm512_loadu_si512(s + 128));
+    x3 = fold512(x3, &g_fold_2048, _mm512_loadu_si512(s + 192));
+  }
+  __m512i x = fold512(x0, &g_fold_1536, x3);
+  x = fold512(x1, &g_fold_1024, x);
+  x = fold512(x2, &g_fold_512, x);
+  for (; len >= 64; s += 64, len -= 64) {
+    x = fold512(x, &g_fold_512, _mm512_loadu_si512(s));
+  }
+  __m128i y = fold128(_mm512_extracti32x4_epi32(x, 0), &g_fold_384,
+                      _mm512_extracti32x4_epi32(x, 3));
+  y = fold128(_mm512_extracti32x4_epi32(x, 1), &g_fold_256, y);
+  y = fold128(_mm512_extracti32x4_epi32(x, 2), &g_fold_128, y);
+  for (; len >= 16; s += 16, len -= 16) {
+    y = fold128(y, &g_fold_128, _mm_loadu_si128((const __m128i *)s));
+  }
+  uint64_t h = _mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(y));
+  h = _mm_crc32_u64(h, (uint64_t)_mm_extract_epi64(y, 1));
+  return crc32c_hw_extend(~(uint32_t)h, s, len);
+}
+#else
+static uint32_t crc32c_hw3_extend(uint32_t crc, const char *src, size_t len) {
+  return crc32c_hw_extend(crc, src, len);
+}
+
+static uint32_t crc32c_vpclmul_extend(uint32_t crc, const char *src,
+                                      size_t len) {
+  return crc32c_hw_extend(crc, src, len);
+}
+#endif
+
+uint32_t crc32c_hw3(const char *src, size_t len) {
+  pthread_once(&g_crc32c_once, crc32c_init);
+  return crc32c_hw3_extend(0, src, len);
+}
+
+uint32_t crc32c_vpclmul(const char *src, size_t len) {
+  pthread_once(&g_crc32c_once, crc32c_init);
+  return crc32c_vpclmul_extend(0, src, len);
+}
 #else
 uint32_t crc32c_hw(const char *src, size_t len) { return crc32c_sw(src, len); }
+uint32_t crc32c_hw3(const char *src, size_t len) { return crc32c_sw(src, len); }
+uint32_t crc32c_vpclmul(const char *src, size_t len) {
+  return crc32c_sw(src, len);
+}
 #endif
 
 static void crc32c_init(void) {
+  constants_init();
+  table_init();
   if (g_force_sw) {
     g_impl = CRC32C_IMPL_SW;
     return;
   }
 
+  crc32c_impl best = CRC32C_IMPL_SW;
+  if (cpu_has_vpclmul()) {
+    best = CRC32C_IMPL_VPCLMUL;
+  } else if (cpu_has_pclmul()) {
+    best = CRC32C_IMPL_HW3;
+  } else if (cpu_has_hw_crc()) {
+    best = CRC32C_IMPL_HW;
+  }
+
+  /* A forced implementation the CPU lacks falls back to software. */
   const char *env = getenv("CRC32C_FORCE");
   if (env != NULL) {
-    if (strcmp(env, "sw") == 0) {
+    if (strcmp(env, "bitwise") == 0) {
+      g_impl = CRC32C_IMPL_BITWISE;
+      return;
+    } else if (strcmp(env, "sw") == 0 || strcmp(env, "sw16") == 0) {
       g_force_sw = 1;
     } else if (strcmp(env, "hw") == 0) {
-      g_force_sw = 0;
-      if (!cpu_has_hw_crc()) {
-        g_force_sw = 1;
-      }
+      if (!cpu_has_hw_crc()) g_force_sw = 1;
+      best = CRC32C_IMPL_HW;
+    } else if (strcmp(env, "hw3") == 0) {
+      if (!cpu_has_pclmul()) g_force_sw = 1;
+      best = CRC32C_IMPL_HW3;
+    } else if (strcmp(env, "vpclmul") == 0) {
+      if (!cpu_has_vpclmul()) g_force_sw = 1;
+      best = CRC32C_IMPL_VPCLMUL;
     }
   }
 
-  if (!g_force_sw && cpu_has_hw_crc()) {
-    g_impl = CRC32C_IMPL_HW;
-  } else {
-    g_impl = CRC32C_IMPL_SW;
-  }
+  g_impl = g_force_sw ? CRC32C_IMPL_SW : best;
 }
 
 const char *crc32c_impl_name(void) {
   pthread_once(&g_crc32c_once, crc32c_init);
-  return (g_impl == CRC32C_IMPL_HW) ? "hw" : "sw";
+  switch (g_impl) {
+    case CRC32C_IMPL_HW:
+      return "hw";
+    case CRC32C_IMPL_HW3:
+      return "hw3";
+    case CRC32C_IMPL_VPCLMUL:
+      return "vpclmul";
+    case CRC32C_IMPL_BITWISE:
+      return "bitwise";
+    default:
+      return "sw16";
+  }
 }
 
 int crc32c_hw_available(void) { return cpu_has_hw_crc(); }
 
+int crc32c_hw3_available(void) { return cpu_has_pclmul(); }
+
+int crc32c_vpclmul_available(void) { return cpu_has_vpclmul(); }
+
 void crc32c_force_software(void) {
   g_force_sw = 1;
   pthread_once(&g_crc32c_once, crc32c_init);
-  g_impl = CRC32C_IMPL_SW;
+  if (g_impl != CRC32C_IMPL_BITWISE) g_impl = CRC32C_IMPL_SW;
 }
 
 int crc32c_selfcheck(void) {
-#if X86_ONLY
   pthread_once(&g_crc32c_once, crc32c_init);
-  if (g_impl != CRC32C_IMPL_HW) {
-    return 0;  // Nothing to check or hw unavailable.
+  if (g_impl == CRC32C_IMPL_BITWISE) {
+    return 0;  // Nothing to check against.
   }
+  const int check_hw = g_impl != CRC32C_IMPL_SW;
 
   static const char *k_vec = "123456789";
-  int failures = 0;
+  int sw_failures = 0;
+  int hw_failures = 0;
 
   /* Known vector. */
-  uint32_t hw = crc32c_hw_body(k_vec, strlen(k_vec));
-  uint32_t sw = crc32c_sw(k_vec, strlen(k_vec));
-  if (hw != sw) failures++;
+  uint32_t ref = crc32c_bitwise(k_vec, strlen(k_vec));
+  if (crc32c_sw_extend(0, k_vec, strlen(k_vec)) != ref) sw_failures++;
+#if X86_ONLY
+  if (check_hw && crc32c_hw_body(k_vec, strlen(k_vec)) != ref) hw_failures++;
+#endif
 
-  /* Alignment/length coverage. */
-  uint8_t pattern[512];
+  /* Alignment/length coverage, long enough for the interleaved streams and
+   * the folding loops. */
+  static uint8_t pattern[3 * LONG_STREAM + 1024];
   for (size_t i = 0; i < sizeof(pattern); i++) pattern[i] = (uint8_t)(i * 3 + 1);
 
   const size_t offsets[] = {0, 1, 2, 3, 4, 7, 8, 15, 31, 63};
-  const size_t lengths[] = {0, 1, 2, 3, 4, 7, 8, 15, 16, 31, 32, 63, 64, 255};
+  const size_t lengths[] = {0,   1,   2,    3,    4,   7,   8,
+                            15,  16,  31,   32,   63,  64,  255,
+                            256, 257, 767,  768,  1000, 4096,
+                            3 * LONG_STREAM + 900};
   for (size_t oi = 0; oi < sizeof(offsets) / sizeof(offsets[0]); oi++) {
     for (size_t li = 0; li < sizeof(lengths) / sizeof(lengths[0]); li++) {
       size_t off = offsets[oi];
       size_t len = lengths[li];
       if (off + len > sizeof(pattern)) continue;
       const char *p = (const char *)(pattern + off);
-      uint32_t hw_v = crc32c_hw_body(p, len);
-      uint32_t sw_v = crc32c_sw(p, len);
-      if (hw_v != sw_v) {
-        failures++;
+      uint32_t ref_v = crc32c_bitwise(p, len);
+      if (crc32c_sw_extend(0, p, len) != ref_v) sw_failures++;
+#if X86_ONLY
+      if (!check_hw) continue;
+      if (crc32c_hw_body(p, len) != ref_v) hw_failures++;
+      if (cpu_has_pclmul() && crc32c_hw3_extend(0, p, len) != ref_v) {
+        hw_failures++;
       }
+      if (cpu_has_vpclmul() && crc32c_vpclmul_extend(0, p, len) != ref_v) {
+        hw_failures++;
+      }
+#endif
     }
   }
 
-  if (failures) {
+  /* Broken tables leave only the bitwise loop to fall back on. */
+  if (sw_failures) {
+    g_force_sw = 1;
+    g_impl = CRC32C_IMPL_BITWISE;
+    return -1;
+  }
+  if (hw_failures) {
     crc32c_force_software();
     return -1;
   }
-#endif
   return 0;
 }
 
 uint32_t crc32c(const char *src, size_t len) {
+  return crc32c_extend(0, src, len);
+}
+
+uint32_t crc32c_extend(uint32_t crc, const char *src, size_t len) {
   pthread_once(&g_crc32c_once, crc32c_init);
-  if (g_impl == CRC32C_IMPL_HW) {
 #if X86_ONLY
-    return crc32c_hw_body(src, len);
+  switch (g_impl) {
+    case CRC32C_IMPL_HW:
+      return crc32c_hw_extend(crc, src, len);
+    case CRC32C_IMPL_HW3:
+      return crc32c_hw3_extend(crc, src, len);
+    case CRC32C_IMPL_VPCLMUL:
+      return crc32c_vpclmul_extend(crc, src, len);
+    default:
+      break;
+  }
+#endif
+  if (g_impl == CRC32C_IMPL_BITWISE) {
+    return crc32c_bitwise_extend(crc, src, len);
+  }
+  return crc32c_sw_extend(crc, src, len);
+}
+
+/* Shifts 'crc_a' over 'len_b' bytes by multiplying by x^(8 * len_b). The
+ * pre and post conditioning of the two CRCs cancel out. */
+uint32_t crc32c_combine_sw(uint32_t crc_a, uint32_t crc_b, size_t len_b) {
+  pthread_once(&g_crc32c_once, crc32c_init);
+  uint32_t p = (uint32_t)1 << 31; /* x^0 */
+  for (int k = 3; len_b; len_b >>= 1, k++) {
+    if (len_b & 1) p = multmodp(g_x2n[k & 63], p);
+  }
+  return multmodp(p, crc_a) ^ crc_b;
+}
+
+#ifdef __x86_64__
+/* Shifts over the odd bytes with crc32 instructions on zeros, then over the
+ * whole words with one carryless multiplication, by a multiplier itself made
+ * by carryless multiplications of g_word_shift entries, each of which keeps
+ * the product's x^-33. */
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crc32c_combine_pclmul(uint32_t crc_a, uint32_t crc_b,
+                                      size_t len_b) {
+  uint64_t h = crc_a;
+  for (size_t i = 0; i < (len_b & 7); i++) h = _mm_crc32_u8(h, 0);
+  uint64_t words = len_b >> 3;
+  if (words) {
+    uint64_t shift = 0;
+    for (int k = 0; words; words >>= 1, k++) {
+      if (!(words & 1)) continue;
+      shift = shift ? crc32c_shift(shift, g_word_shift[k]) : g_word_shift[k];
+    }
+    h = crc32c_shift(h, shift);
+  }
+  return (uint32_t)h ^ crc_b;
+}
+
+uint32_t crc32c_combine_hw(uint32_t crc_a, uint32_t crc_b, size_t len_b) {
+  pthread_once(&g_crc32c_once, crc32c_init);
+  if (!cpu_has_pclmul()) return crc32c_combine_sw(crc_a, crc_b, len_b);
+  return crc32c_combine_pclmul(crc_a, crc_b, len_b);
+}
 #else
-    return crc32c_sw(src, len);
+uint32_t crc32c_combine_hw(uint32_t crc_a, uint32_t crc_b, size_t len_b) {
+  return crc32c_combine_sw(crc_a, crc_b, len_b);
+}
 #endif
+
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t len_b) {
+  pthread_once(&g_crc32c_once, crc32c_init);
+  if (g_impl == CRC32C_IMPL_HW3 || g_impl == CRC32C_IMPL_VPCLMUL) {
+    return crc32c_combine_hw(crc_a, crc_b, len_b);
   }
-  return crc32c_sw(src, len);
+  return crc32c_combine_sw(crc_a, crc_b, len_b);
 }
@@ -24,23 +24,48 @@ typedef enum {
   CRC32C_IMPL_AUTO = 0,
   CRC32C_IMPL_HW,
   CRC32C_IMPL_SW,
+  CRC32C_IMPL_HW3,
+  CRC32C_IMPL_VPCLMUL,
+  CRC32C_IMPL_BITWISE,
 } crc32c_impl;
 
-// Returns the selected implementation name: "hw" or "sw".
+// Returns the selected implementation name: "hw" (one crc32 instruction
+// chain), "hw3" (three chains joined by PCLMULQDQ), "vpclmul" (AVX-512
+// VPCLMULQDQ folding), "sw16" (slicing-by-16 tables) or "bitwise" (the bit
+// at a time reference). The widest the CPU supports is selected, unless the
+// CRC32C_FORCE environment variable names another, with "sw" for "sw16".
 const char *crc32c_impl_name(void);
 
 // Returns 1 if the CPU supports the CRC32 instruction, 0 otherwise.
 int crc32c_hw_available(void);
 
-// Forces the dispatcher to use the pure software implementation.
+// Returns 1 if the CPU supports the "hw3" implementation, 0 otherwise.
+int crc32c_hw3_available(void);
+
+// Returns 1 if the CPU supports the "vpclmul" implementation, 0 otherwise.
+int crc32c_vpclmul_available(void);
+
+// Forces the dispatcher to use the table driven software implementation.
 void crc32c_force_software(void);
 
-// Runs a quick self-check comparing hw vs sw (if hw available). Returns 0 on
-// success; on any mismatch, forces software and returns non-zero.
+// Runs a quick self-check comparing the software and each available hw
+// implementation with the bitwise reference. Returns 0 on success; on any
+// mismatch, forces software, or bitwise if software mismatched, and returns
+// non-zero.
 int crc32c_selfcheck(void);
 
 uint32_t crc32c(const char *s, size_t len);
 
+// Returns the CRC32C of the data whose CRC32C is 'crc', followed by 'len'
+// bytes at 's'. crc32c_extend(0, s, len) == crc32c(s, len).
+uint32_t crc32c_extend(uint32_t crc, const char *s, size_t len);
+
+// Returns the CRC32C of data A followed by data B, given A's CRC32C 'crc_a',
+// B's 'crc_b' and B's length 'len_b', so that pieces of a buffer may be
+// checksummed separately, perhaps in parallel, then joined exactly. Uses
+// PCLMULQDQ where the selected implementation does.
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, size_t len_b);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,339 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Measures CRC32C throughput of each implementation the CPU supports, on
+// each CPU in turn, over a sweep of buffer sizes and alignments.
+//
+// Emits one JSON record per CPU, implementation, size and alignment, with
+// GB/s and ticks per byte (TSC cycles on x86, see Ticks), then a summary
+// record per implementation, size and alignment giving the spread across
+// CPUs. CPUs slower than the median by more than a tolerance are listed in
+// the summary; a core that is persistently slow where its peers are not is
+// worth a closer look.
+//
+// Each CPU is measured from its own pinned thread, one CPU at a time, so
+// that SMT siblings and shared caches don't perturb one another. Exits 3 if
+// any CPU was slow.
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crc32c.h"
+#include "log.h"
+#include "round_stats.h"
+#include "topology.h"
+#include "utils.h"
+
+extern "C" {
+uint32_t crc32c_bitwise(const char *, size_t);
+uint32_t crc32c_hw(const char *, size_t);
+uint32_t crc32c_hw3(const char *, size_t);
+uint32_t crc32c_sw(const char *, size_t);
+uint32_t crc32c_vpclmul(const char *, size_t);
+}
+
+namespace {
+
+constexpr size_t kMinSize = 16;
+constexpr size_t kMaxSize = 64 << 20;
+constexpr size_t kPageSize = 4096;
+
+struct Impl {
+  const char *name;
+  uint32_t (*fn)(const char *, size_t);
+  size_t max_size;  // Larger sizes take too long to be worth measuring.
+};
+
+// Returns the implementations the CPU supports.
+std::vector<Impl> Implementations() {
+  std::vector<Impl> impls;
+  impls.push_back({"bitwise", crc32c_bitwise, 1 << 20});
+  impls.push_back({"sw16", crc32c_sw, kMaxSize});
+  if (crc32c_hw_available()) impls.push_back({"hw", crc32c_hw, kMaxSize});
+  if (crc32c_hw3_available()) impls.push_back({"hw3", crc32c_hw3, kMaxSize});
+  if (crc32c_vpclmul_available()) {
+    impls.push_back({"vpclmul", crc32c_vpclmul, kMaxSize});
+  }
+  return impls;
+}
+
+struct Sample {
+  int cpu;
+  const Impl *impl;
+  size_t size;
+  size_t align;
+  double gbps;
+  double ticks_per_byte;
+};
+
+struct Options {
+  std::vector<int> cpus;
+  std::vector<size_t> alignments = {0, 1, 8, 63};
+  size_t max_size = kMaxSize;
+  double seconds = 0.02;    // Minimum duration of each measurement
+  double tolerance = 0.10;  // Fraction below median that marks an outlier
+};
+
+bool Pin(int cpu) {
+  cpu_set_t cset;
+  CPU_ZERO(&cset);
+  CPU_SET(cpu, &cset);
+  return sched_setaffinity(0, sizeof(cset), &cset) == 0;
+}
+
+// Times 'impl' over 'size' bytes at 'p', repeating until at least
+// 'seconds' elapse, and returns the best of three such runs.
+Sample Measure(const Impl &impl, const char *p, size_t size, double seconds) {
+  Sample best = {-1, &impl, size, 0, 0.0, 0.0};
+  uint64_t reps = 1;
+  for (int run = 0; run < 3;) {
+    uint32_t sink = 0;
+    const double t0 = TimeInSeconds();
+    const uint64_t c0 = cpu_check::Ticks();
+    for (uint64_t i = 0; i < reps; i++) {
+      sink += impl.fn(p, size);
+      asm volatile("" : "+r"(sink));
+    }
+    const uint64_t c1 = cpu_check::Ticks();
+    const double t = TimeInSeconds() - t0;
+    if (t < seconds) {
+      // Calibrating: scale the repetition count up towards 'seconds'.
+      reps = t > 0 ? std::max(2 * reps, uint64_t(reps * seconds / t * 1.2))
+                   : 2 * reps;
+      continue;
+    }
+    const double bytes = static_cast<double>(reps) * size;
+    const double gbps = bytes / t / 1e9;
+    if (gbps > best.gbps) {
+      best.gbps = gbps;
+      best.ticks_per_byte = (c1 - c0) / bytes;
+    }
+    run++;
+  }
+  return best;
+}
+
+// Runs the sweep on 'cpu', from a thread pinned to it. The buffer is
+// allocated and filled there too, so it is local to the CPU's node.
+std::vector<Sample> SweepCpu(int cpu, const std::vector<Impl> &impls,
+                             const Options &options) {
+  std::vector<Sample> samples;
+  std::thread t([&] {
+    if (!Pin(cpu)) {
+      LOG(ERROR) << "setaffinity to cpu " << cpu
+                 << " failed: " << strerror(errno);
+      return;
+    }
+    const size_t capacity = options.max_size + kPageSize;
+    char *base = static_cast<char *>(aligned_alloc(kPageSize, capacity));
+    std::knuth_b rng(cpu);
+    std::uniform_int_distribution<int> dist(0, 255);
+    for (size_t i = 0; i < capacity; i++) base[i] = dist(rng);
+
+    for (size_t size = kMinSize; size <= options.max_size; size *= 4) {
+      for (size_t align : options.alignments) {
+        const char *p = base + align;
+        const uint32_t want = crc32c_sw(p, size);
+        for (const Impl &impl : impls) {
+          if (size > impl.max_size) continue;
+          const uint32_t got = impl.fn(p, size);
+          if (got != want) {
+            LOG(ERROR) << "cpu " << cpu << " " << impl.name << " size "
+                       << size << " align " << align << " mismatch: " << got
+                       << " vs " << want;
+          }
+          Sample s = Measure(impl, p, size, options.seconds);
+          s.cpu = cpu;
+          s.align = align;
+          samples.push_back(s);
+        }
+      }
+    }
+    free(base);
+  });
+  t.join();
+  return samples;
+}
+
+std::string SampleJson(const Sample &s, const cpu_check::CpuTopology &topo) {
+  std::stringstream j;
+  j << Json("cpu", s.cpu) << ", " << Json("core", topo.CanonicalCore(s.cpu))
+    << ", " << Json("impl", s.impl->name) << ", "
+    << Json("size", uint64_t{s.size}) << ", "
+    << Json("align", uint64_t{s.align}) << ", " << Json("gbps", s.gbps)
+    << ", " << Json("ticks_per_byte", s.ticks_per_byte) << ", "
+    << Json("ticks_per_us", cpu_check::TicksPerMicrosecond());
+  return "{ " + JsonRecord("crc32c", j.str()) + ", " + JTag() + " }";
+}
+
+// Emits a summary of 'samples', which share implementation, size and
+// alignment, across CPUs. Returns the CPUs slower than the median by more
+// than 'tolerance'.
+std::vector<int> Summarize(std::vector<Sample> samples, double tolerance) {
+  std::sort(samples.begin(), samples.end(),
+            [](const Sample &a, const Sample &b) { return a.gbps < b.gbps; });
+  const Sample &first = samples.front();
+  const double median = samples[samples.size() / 2].gbps;
+  std::vector<int> slow;
+  for (const Sample &s : samples) {
+    if (s.gbps < (1.0 - tolerance) * median) slow.push_back(s.cpu);
+  }
+  std::sort(slow.begin(), slow.end());
+  std::stringstream list;
+  for (size_t i = 0; i < slow.size(); i++) {
+    list << (i ? ", " : "") << slow[i];
+  }
+  std::stringstream j;
+  j << Json("impl", first.impl->name) << ", "
+    << Json("size", uint64_t{first.size}) << ", "
+    << Json("align", uint64_t{first.align}) << ", "
+    << Json("cpus", static_cast<int>(samples.size())) << ", "
+    << Json("min_gbps", first.gbps) << ", " << Json("median_gbps", median)
+    << ", " << Json("max_gbps", samples.back().gbps) << ", \"slow_cpus\": ["
+    << list.str() << "]";
+  std::cout << "{ " << JsonRecord("crc32c_summary", j.str()) << ", " << JTag()
+            << " }" << std::endl;
+  return slow;
+}
+
+// Parses comma separated numbers from 'c' into 'v'. Returns false if none.
+template <typename T>
+bool ParseList(const std::string &c, std::vector<T> *v) {
+  v->clear();
+  std::stringstream s(c);
+  T t;
+  while (s >> t) {
+    v->push_back(t);
+    if (s.peek() == ',') s.ignore();
+  }
+  return !v->empty() && s.eof();
+}
+
+void UsageIf(bool v) {
+  if (!v) return;
+  LOG(ERROR) << "Usage crc32c_bench [-a align,...] [-c cpu,...] [-m max_size]"
+             << " [-s seconds] [-o tolerance]"
+             << "\n  a: Buffer misalignments in bytes (default 0,1,8,63)"
+             << "\n  c: CPUs to measure (default all known)"
+             << "\n  m: Largest buffer, at most 64 MiB (default 64 MiB)"
+             << "\n  s: Minimum seconds per measurement (default 0.02)"
+             << "\n  o: Fraction below median marking a slow CPU"
+             << " (default 0.1)";
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const char *flag = argv[i];
+    UsageIf(flag[0] != '-');
+    for (flag++; *flag != 0; flag++) {
+      switch (*flag) {
+        case 'a': {
+          std::string c(++flag);
+          flag += c.length() - 1;
+          UsageIf(!ParseList(c, &options.alignments));
+          for (size_t a : options.alignments) UsageIf(a >= kPageSize);
+          break;
+        }
+        case 'c': {
+          std::string c(++flag);
+          flag += c.length() - 1;
+          UsageIf(!ParseList(c, &options.cpus));
+          break;
+        }
+        case 'm': {
+          std::string c(++flag);
+          flag += c.length() - 1;
+          std::stringstream s(c);
+          UsageIf((s >> options.max_size).fail());
+          UsageIf(options.max_size < kMinSize || options.max_size > kMaxSize);
+          break;
+        }
+        case 'o': {
+          std::string c(++flag);
+          flag += c.length() - 1;
+          std::stringstream s(c);
+          UsageIf((s >> options.tolerance).fail());
+          break;
+        }
+        case 's': {
+          std::string c(++flag);
+          flag += c.length() - 1;
+          std::stringstream s(c);
+          UsageIf((s >> options.seconds).fail());
+          break;
+        }
+        default:
+          UsageIf(true);
+      }
+    }
+  }
+
+  const cpu_check::CpuTopology topology = cpu_check::CpuTopology::FromSysfs();
+  if (options.cpus.empty()) {
+    options.cpus = topology.Cpus();
+    if (options.cpus.empty()) {
+      cpu_set_t cset;
+      CPU_ZERO(&cset);
+      sched_getaffinity(0, sizeof(cset), &cset);
+      for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &cset)) options.cpus.push_back(c);
+      }
+    }
+  }
+  const std::vector<Impl> impls = Implementations();
+  LOG(INFO) << "Selected CRC32C implementation: " << crc32c_impl_name();
+
+  // Each CPU's samples are in the same order, so the k'th of each share
+  // implementation, size and alignment.
+  std::vector<std::vector<Sample>> per_cpu;
+  for (int cpu : options.cpus) {
+    LOG(INFO) << "Measuring cpu " << cpu;
+    std::vector<Sample> samples = SweepCpu(cpu, impls, options);
+    if (samples.empty()) continue;
+    for (const Sample &s : samples) {
+      std::cout << SampleJson(s, topology) << std::endl;
+    }
+    per_cpu.push_back(std::move(samples));
+  }
+  if (per_cpu.empty()) return 1;
+
+  int outliers = 0;
+  for (size_t k = 0; k < per_cpu[0].size(); k++) {
+    std::vector<Sample> across;
+    for (const std::vector<Sample> &samples : per_cpu) {
+      across.push_back(samples[k]);
+    }
+    for (int cpu : Summarize(across, options.tolerance)) {
+      LOG(WARN) << "cpu " << cpu << " slow: " << across[0].impl->name
+                << " size " << across[0].size << " align "
+                << across[0].align;
+      outliers++;
+    }
+  }
+  return outliers ? 3 : 0;
+}
@@ -22,8 +22,13 @@
 #include "crc32c.h"
 
 extern "C" {
+uint32_t crc32c_bitwise(const char *, size_t);
+uint32_t crc32c_combine_hw(uint32_t, uint32_t, size_t);
+uint32_t crc32c_combine_sw(uint32_t, uint32_t, size_t);
 uint32_t crc32c_hw(const char *, size_t);
+uint32_t crc32c_hw3(const char *, size_t);
 uint32_t crc32c_sw(const char *, size_t);
+uint32_t crc32c_vpclmul(const char *, size_t);
 }
 
 namespace {
@@ -34,6 +39,23 @@ void MaybeReportMismatch(const char *label, uint32_t got, uint32_t want,
           len);
   (*failures)++;
 }
+
+// Checks the software implementation, and each hardware implementation the
+// CPU supports, against 'ref'.
+void CheckImplementations(const char *p, size_t len, uint32_t ref,
+                          int *failures) {
+  MaybeReportMismatch("sw", crc32c_sw(p, len), ref, len, failures);
+  if (crc32c_hw_available()) {
+    MaybeReportMismatch("hw", crc32c_hw(p, len), ref, len, failures);
+  }
+  if (crc32c_hw3_available()) {
+    MaybeReportMismatch("hw3", crc32c_hw3(p, len), ref, len, failures);
+  }
+  if (crc32c_vpclmul_available()) {
+    MaybeReportMismatch("vpclmul", crc32c_vpclmul(p, len), ref, len,
+                        failures);
+  }
+}
 }  // namespace
 
 int main(int argc, char **argv) {
@@ -41,36 +63,44 @@ int main(int argc, char **argv) {
 
   // Known vector: CRC32C("123456789") = 0xe3069283
   static const char *k_vec = "123456789";
-  uint32_t vec_sw = crc32c_sw(k_vec, strlen(k_vec));
-  MaybeReportMismatch("known-vector-sw", vec_sw, 0xe3069283, strlen(k_vec),
-                      &failures);
+  uint32_t vec_ref = crc32c_bitwise(k_vec, strlen(k_vec));
+  MaybeReportMismatch("known-vector-bitwise", vec_ref, 0xe3069283,
+                      strlen(k_vec), &failures);
   uint32_t vec_dispatch = crc32c(k_vec, strlen(k_vec));
-  MaybeReportMismatch("dispatch", vec_dispatch, vec_sw, strlen(k_vec),
+  MaybeReportMismatch("dispatch", vec_dispatch, vec_ref, strlen(k_vec),
                       &failures);
-  if (crc32c_hw_available()) {
-    uint32_t vec_hw = crc32c_hw(k_vec, strlen(k_vec));
-    MaybeReportMismatch("known-vector-hw", vec_hw, vec_sw, strlen(k_vec),
-                        &failures);
-  }
+  CheckImplementations(k_vec, strlen(k_vec), vec_ref, &failures);
 
   // Alignment and edge-length coverage.
   std::vector<size_t> offsets = {0, 1, 2, 3, 4, 7, 8, 15, 31, 63};
-  std::vector<size_t> lengths = {0, 1, 2, 3, 4, 7, 8, 15, 16,
-                                 31, 32, 63, 64, 255, 256, 511};
-  std::vector<unsigned char> pattern(1024);
+  std::vector<size_t> lengths = {0,   1,   2,   3,   4,    7,    8,
+                                 15,  16,  31,  32,  63,   64,   255,
+                                 256, 511, 767, 768, 4095, 12288, 13000};
+  std::vector<unsigned char> pattern(16384);
   for (size_t i = 0; i < pattern.size(); ++i) pattern[i] = (unsigned char)(i * 5 + 1);
 
   for (size_t off : offsets) {
     for (size_t len : lengths) {
       if (off + len > pattern.size()) continue;
       const char *p = reinterpret_cast<const char *>(pattern.data() + off);
-      uint32_t sw = crc32c_sw(p, len);
+      uint32_t ref = crc32c_bitwise(p, len);
       uint32_t disp = crc32c(p, len);
-      MaybeReportMismatch("dispatch", disp, sw, len, &failures);
-      if (crc32c_hw_available()) {
-        uint32_t hw = crc32c_hw(p, len);
-        MaybeReportMismatch("hw", hw, sw, len, &failures);
-      }
+      MaybeReportMismatch("dispatch", disp, ref, len, &failures);
+      CheckImplementations(p, len, ref, &failures);
+    }
+  }
+
+  // Combining with short and empty second pieces.
+  for (size_t len : lengths) {
+    const char *p = reinterpret_cast<const char *>(pattern.data());
+    uint32_t ref = crc32c_bitwise(p, 3 + len);
+    uint32_t a = crc32c_bitwise(p, 3);
+    uint32_t b = crc32c_bitwise(p + 3, len);
+    MaybeReportMismatch("combine-sw", crc32c_combine_sw(a, b, len), ref, len,
+                        &failures);
+    if (crc32c_hw3_available()) {
+      MaybeReportMismatch("combine-hw", crc32c_combine_hw(a, b, len), ref, len,
+                          &failures);
     }
   }
 
@@ -83,12 +113,25 @@ int main(int argc, char **argv) {
     size_t len = size_dist(rndeng);
     buf.resize(len);
     for (size_t j = 0; j < len; j++) buf[j] = static_cast<char>(d_dist(rndeng));
-    uint32_t sw = crc32c_sw(buf.data(), len);
+    uint32_t ref = crc32c_bitwise(buf.data(), len);
     uint32_t disp = crc32c(buf.data(), len);
-    MaybeReportMismatch("dispatch", disp, sw, len, &failures);
-    if (crc32c_hw_available()) {
-      uint32_t hw = crc32c_hw(buf.data(), len);
-      MaybeReportMismatch("hw", hw, sw, len, &failures);
+    MaybeReportMismatch("dispatch", disp, ref, len, &failures);
+    CheckImplementations(buf.data(), len, ref, &failures);
+    // Extending across a random split must match the whole.
+    size_t split = std::uniform_int_distribution<size_t>(0, len)(rndeng);
+    uint32_t ext = crc32c_extend(crc32c_extend(0, buf.data(), split),
+                                 buf.data() + split, len - split);
+    MaybeReportMismatch("extend", ext, ref, len, &failures);
+    // As must combining the CRCs of the two pieces.
+    uint32_t a = crc32c(buf.data(), split);
+    uint32_t b = crc32c(buf.data() + split, len - split);
+    MaybeReportMismatch("combine", crc32c_combine(a, b, len - split), ref,
+                        len, &failures);
+    MaybeReportMismatch("combine-sw", crc32c_combine_sw(a, b, len - split),
+                        ref, len, &failures);
+    if (crc32c_hw3_available()) {
+      MaybeReportMismatch("combine-hw", crc32c_combine_hw(a, b, len - split),
+                          ref, len, &failures);
     }
   }
 
@@ -23,6 +23,28 @@ namespace {
 constexpr unsigned char key[33] = "0123456789abcdef0123456789abcdef";
 };  // namespace
 
+Crypto::~Crypto() {
+  EVP_CIPHER_CTX_free(encrypt_ctx_);
+  EVP_CIPHER_CTX_free(decrypt_ctx_);
+}
+
+EVP_CIPHER_CTX *Crypto::Context(int enc, const unsigned char *i_vec) {
+  EVP_CIPHER_CTX *&cipher_ctx = enc ? encrypt_ctx_ : decrypt_ctx_;
+  if (cipher_ctx == nullptr) {
+    cipher_ctx = EVP_CIPHER_CTX_new();
+    if (cipher_ctx == nullptr) return nullptr;
+    if (EVP_CipherInit_ex(cipher_ctx, EVP_aes_256_gcm(), NULL, key, NULL,
+                          enc) != 1) {
+      return nullptr;
+    }
+  }
+  // Keeps the cipher and key schedule, and starts a new message.
+  if (EVP_CipherInit_ex(cipher_ctx, NULL, NULL, NULL, i_vec, enc) != 1) {
+    return nullptr;
+  }
+  return cipher_ctx;
+}
+
 absl::Status Crypto::Encrypt(const MalignBuffer &plain_text,
                              MalignBuffer *cipher_text, CryptoPurse *purse) {
   memset(purse->i_vec, 0, sizeof(purse->i_vec));
@@ -31,28 +53,29 @@ absl::Status Crypto::Encrypt(const MalignBuffer &plain_text,
 
   int enc_len = 0;
   int enc_unused_len = 0;
-  EVP_CIPHER_CTX *cipher_ctx = EVP_CIPHER_CTX_new();
+  EVP_CIPHER_CTX *cipher_ctx = Context(1, purse->i_vec);
+  if (cipher_ctx == nullptr) {
+    return ReturnError("encrypt_EVP_CipherInit_ex", &encrypt_ctx_);
+  }
 
-  EVP_CipherInit_ex(cipher_ctx, EVP_aes_256_gcm(), NULL, key, purse->i_vec, 1);
   if (EVP_CipherUpdate(
           cipher_ctx,
           reinterpret_cast<unsigned char *>(cipher_text->data()),
           &enc_len, reinterpret_cast<const unsigned char *>(plain_text.data()),
           plain_text.size()) != 1) {
-    return ReturnError("EVP_CipherUpdate", cipher_ctx);
+    return ReturnError("EVP_CipherUpdate", &encrypt_ctx_);
   }
   if (EVP_CipherFinal_ex(cipher_ctx, nullptr, &enc_unused_len) != 1) {
-    return ReturnError("encrypt_EVP_CipherFinal_ex", cipher_ctx);
+    return ReturnError("encrypt_EVP_CipherFinal_ex", &encrypt_ctx_);
   }
   enc_len += enc_unused_len;
   if (enc_len != (int)cipher_text->size()) {
-    return ReturnError("encrypt_length_mismatch", cipher_ctx);
+    return ReturnError("encrypt_length_mismatch", &encrypt_ctx_);
   }
   if (EVP_CIPHER_CTX_ctrl(cipher_ctx, EVP_CTRL_GCM_GET_TAG,
                           sizeof(purse->gmac_tag), purse->gmac_tag) != 1) {
-    return ReturnError("EVP_CTRL_GCM_GET_TAG", cipher_ctx);
+    return ReturnError("EVP_CTRL_GCM_GET_TAG", &encrypt_ctx_);
   }
-  EVP_CIPHER_CTX_free(cipher_ctx);
   return absl::OkStatus();
 }
 
@@ -61,9 +84,10 @@ absl::Status Crypto::Decrypt(const MalignBuffer &cipher_text,
                              MalignBuffer *plain_text) {
   int dec_len = 0;
   int dec_extra_len = 0;
-  EVP_CIPHER_CTX *cipher_ctx = EVP_CIPHER_CTX_new();
-
-  EVP_CipherInit_ex(cipher_ctx, EVP_aes_256_gcm(), NULL, key, purse.i_vec, 0);
+  EVP_CIPHER_CTX *cipher_ctx = Context(0, purse.i_vec);
+  if (cipher_ctx == nullptr) {
+    return ReturnError("decrypt_EVP_CipherInit_ex", &decrypt_ctx_);
+  }
 
   // Make a non-const copy of gmac_tag because that's what EVP_CIPHER_CTX_ctrl
   // requires, even though it won't be modified in this use.
@@ -72,25 +96,24 @@ absl::Status Crypto::Decrypt(const MalignBuffer &cipher_text,
 
   if (EVP_CIPHER_CTX_ctrl(cipher_ctx, EVP_CTRL_GCM_SET_TAG, sizeof(copied_tag),
                           reinterpret_cast<void *>(copied_tag)) != 1) {
-    return ReturnError("EVP_CTRL_GCM_SET_TAG", cipher_ctx);
+    return ReturnError("EVP_CTRL_GCM_SET_TAG", &decrypt_ctx_);
   }
   if (EVP_CipherUpdate(
           cipher_ctx, reinterpret_cast<unsigned char *>(plain_text->data()),
           &dec_len, reinterpret_cast<const unsigned char *>(cipher_text.data()),
           cipher_text.size()) != 1) {
-    return ReturnError("Decryption", cipher_ctx);
+    return ReturnError("Decryption", &decrypt_ctx_);
   }
   if (EVP_CipherFinal_ex(
           cipher_ctx,
           reinterpret_cast<unsigned char *>(plain_text->data() + dec_len),
           &dec_extra_len) != 1) {
-    return ReturnError("decrypt_EVP_CipherFinal_ex", cipher_ctx);
+    return ReturnError("decrypt_EVP_CipherFinal_ex", &decrypt_ctx_);
   }
   dec_len += dec_extra_len;
   if (dec_len != (int)plain_text->size()) {
-    return ReturnError("decrypt_length_mismatch", cipher_ctx);
+    return ReturnError("decrypt_length_mismatch", &decrypt_ctx_);
   }
-  EVP_CIPHER_CTX_free(cipher_ctx);
   return absl::OkStatus();
 }
 
@@ -105,8 +128,9 @@ absl::Status Crypto::SelfTest() {
 }
 
 absl::Status Crypto::ReturnError(absl::string_view message,
-                                 EVP_CIPHER_CTX *cipher_ctx) {
-  EVP_CIPHER_CTX_free(cipher_ctx);
+                                 EVP_CIPHER_CTX **cipher_ctx) {
+  EVP_CIPHER_CTX_free(*cipher_ctx);
+  *cipher_ctx = nullptr;
   return absl::Status(absl::StatusCode::kInternal, message);
 }
 };  // namespace cpu_check
@@ -23,6 +23,9 @@
 
 namespace cpu_check {
 
+// AES-256-GCM with a fixed key. Keeps a cipher context for each direction,
+// with the key schedule made on first use, so only the i_vec is set up for
+// each message. A Crypto is for one thread.
 class Crypto {
  public:
   // Encryption produces these values, which are consumed by decryption.
@@ -31,23 +34,36 @@ class Crypto {
     unsigned char gmac_tag[16];
   };
 
+  Crypto() {}
+  ~Crypto();
+  Crypto(const Crypto &) = delete;
+  Crypto &operator=(const Crypto &) = delete;
+
   // Encrypts 'plain_text' to 'cipher_text' and stores i_vec and gmac
-  // in 'purse'.
-  static absl::Status Encrypt(const MalignBuffer &plain_text,
-                              MalignBuffer *cipher_text, CryptoPurse *purse);
+  // in 'purse'. 'cipher_text' may be 'plain_text', to encrypt in place.
+  absl::Status Encrypt(const MalignBuffer &plain_text,
+                       MalignBuffer *cipher_text, CryptoPurse *purse);
 
   // Decrypts 'cipher_text' into 'plain_text' using i_vec and gmac from 'purse'.
-  static absl::Status Decrypt(const MalignBuffer &cipher_text,
-                              const CryptoPurse &purse,
-                              MalignBuffer *plain_text);
+  // 'plain_text' may be 'cipher_text', to decrypt in place.
+  absl::Status Decrypt(const MalignBuffer &cipher_text,
+                       const CryptoPurse &purse, MalignBuffer *plain_text);
 
   // Runs crypto self test, if available.
   static absl::Status SelfTest();
 
  private:
-  // Returns kInternal error and frees context 'cipher_ctx'.
+  // Returns the context for encryption, if 'enc' is 1, or decryption, if 0,
+  // set up for a message with 'i_vec', or nullptr on failure.
+  EVP_CIPHER_CTX *Context(int enc, const unsigned char *i_vec);
+
+  // Returns kInternal error and frees context '*cipher_ctx', so that its
+  // next use starts afresh.
   static absl::Status ReturnError(absl::string_view message,
-                                  EVP_CIPHER_CTX *cipher_ctx);
+                                  EVP_CIPHER_CTX **cipher_ctx);
+
+  EVP_CIPHER_CTX *encrypt_ctx_ = nullptr;
+  EVP_CIPHER_CTX *decrypt_ctx_ = nullptr;
 };
 
 };      // namespace cpu_check
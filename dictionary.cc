@@ -0,0 +1,115 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "dictionary.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "log.h"
+
+namespace cpu_check {
+
+const Dictionary& Dictionary::Get() {
+  // Never destroyed, as Workers may outlive main's statics.
+  static const Dictionary* dictionary = [] {
+    // Dictionary search paths
+    static const char* dicts[] = {
+        "/usr/share/dict/words",
+        "words",
+    };
+    Dictionary* d = new Dictionary();
+    for (const char* path : dicts) {
+      if (d->Read(path)) break;
+    }
+    if (d->empty()) LOG(WARN) << "No word list found, skipping Text patterns";
+    return d;
+  }();
+  return *dictionary;
+}
+
+bool Dictionary::Read(const char* path) {
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size > UINT32_MAX) {
+    close(fd);
+    return false;
+  }
+  const size_t file_size = st.st_size;
+  void* m = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED) return false;
+  const char* const file = static_cast<const char*>(m);
+
+  LOG(DEBUG) << "Reading words from " << path;
+
+  // Counting sort of lines by length, which keeps file order among words of
+  // the same length.
+  std::vector<absl::string_view> lines;
+  std::vector<size_t> counts;
+  for (const char* p = file; p < file + file_size;) {
+    const char* eol =
+        static_cast<const char*>(memchr(p, '\n', file + file_size - p));
+    if (eol == nullptr) eol = file + file_size;
+    if (eol > p) {
+      lines.emplace_back(p, eol - p);
+      if (counts.size() <= lines.back().size()) {
+        counts.resize(lines.back().size() + 1);
+      }
+      counts[lines.back().size()]++;
+    }
+    p = eol + 1;
+  }
+
+  // Starting index of each length's words.
+  std::vector<size_t> next(counts.size());
+  for (size_t len = 1; len < counts.size(); len++) {
+    next[len] = next[len - 1] + counts[len - 1];
+  }
+  std::vector<absl::string_view> sorted(lines.size());
+  size_t arena_size = 0;
+  for (absl::string_view line : lines) {
+    sorted[next[line.size()]++] = line;
+    arena_size += line.size();
+  }
+
+  arena_size += kReadSlack;
+  void* a = mmap(nullptr, arena_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (a == MAP_FAILED) {
+    munmap(m, file_size);
+    return false;
+  }
+  char* arena = static_cast<char*>(a);
+  offsets_.resize(1);
+  offsets_.reserve(sorted.size() + 1);
+  uint32_t offset = 0;
+  for (absl::string_view word : sorted) {
+    memcpy(arena + offset, word.data(), word.size());
+    offset += word.size();
+    offsets_.push_back(offset);
+  }
+  munmap(m, file_size);
+  mprotect(arena, arena_size, PROT_READ);
+  arena_ = arena;
+  LOG(DEBUG) << "Read " << size() << " words.";
+  return true;
+}
+
+}  // namespace cpu_check
@@ -0,0 +1,66 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CPU_CHECK_DICTIONARY_H_
+#define THIRD_PARTY_CPU_CHECK_DICTIONARY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace cpu_check {
+
+// Word list for text patterns, read once per process and shared, read only,
+// by all threads. Words are packed end to end, shortest first, in one
+// read-only mapping, indexed by offset.
+class Dictionary {
+ public:
+  // Returns the process's Dictionary, reading it on first use from
+  // /usr/share/dict/words or ./words. Empty if neither is readable.
+  // Thread safe.
+  static const Dictionary& Get();
+
+  Dictionary(const Dictionary&) = delete;
+  Dictionary& operator=(const Dictionary&) = delete;
+
+  // At least this many bytes from the start of any word may be read, though
+  // they run past the end of the word.
+  static constexpr size_t kReadSlack = 16;
+
+  bool empty() const { return size() == 0; }
+  size_t size() const { return offsets_.size() - 1; }
+
+  // Returns word 'i', in order of length, shortest first.
+  absl::string_view word(size_t i) const {
+    return absl::string_view(arena_ + offsets_[i],
+                             offsets_[i + 1] - offsets_[i]);
+  }
+
+ private:
+  Dictionary() {}
+
+  // Reads non-empty lines of 'path' into 'this', returning false if 'path'
+  // cannot be read.
+  bool Read(const char* path);
+
+  const char* arena_ = nullptr;
+  // Word i is arena_[offsets_[i]..offsets_[i + 1]).
+  std::vector<uint32_t> offsets_ = {0};
+};
+
+}  // namespace cpu_check
+#endif  // THIRD_PARTY_CPU_CHECK_DICTIONARY_H_
@@ -0,0 +1,298 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <openssl/sha.h>
+
+#include "blake3.h"
+#include "highway_hash.h"
+#include "sha_lanes.h"
+#include "simd_isa.h"
+#include "xxh3.h"
+
+using cpu_check::SimdIsa;
+
+namespace {
+// XXH3_64bits of the first 'len' bytes of Input, from xxHash.
+struct Xxh3Vector {
+  size_t len;
+  uint64_t hash;
+};
+const Xxh3Vector kXxh3Vectors[] = {
+    {0, 0x2d06800538d394c2},     {1, 0xc44bdff4074eecdb},
+    {3, 0x5f4299fc161c9cbb},     {4, 0x60dab036a58211f2},
+    {8, 0x3a1c2d7c85af88f8},     {9, 0xe9612598145bb9dc},
+    {16, 0x8355e3a6f61770db},    {17, 0x9ef341a99de37328},
+    {128, 0x85c6174c7ff4c46b},   {129, 0xec7642b431ba3e5a},
+    {240, 0x375a384d957fe865},   {241, 0x02e8cd95421c6d02},
+    {1024, 0xe5d78bafa45b2aa5},  {1025, 0xe95c42288f28186e},
+    {4159, 0x3e3129f24dfa2a3d},  {16389, 0x15cef2fbaf507d57},
+    {100000, 0x42c23aeead96750d},
+};
+
+// BLAKE3 of the first 'len' bytes of Input, from BLAKE3's test_vectors.json.
+struct Blake3Vector {
+  size_t len;
+  const char *hex;
+};
+const Blake3Vector kBlake3Vectors[] = {
+    {0, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+    {1, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+    {1023,
+     "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11"},
+    {1024,
+     "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7"},
+    {1025,
+     "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444"},
+    {2049,
+     "5f4d72f40d7a5f82b15ca2b2e44b1de3c2ef86c426c95c1af0b6879522563030"},
+    {8193,
+     "bab6c09cb8ce8cf459261398d2e7aef35700bf488116ceb94a36d0f5f1b7bc3b"},
+    {16384,
+     "f875d6646de28985646f34ee13be9a576fd515f76b5b0a26bb324735041ddde4"},
+    {31744,
+     "62b6960e1a44bcc1eb1a611a8d6235b6b4b78f32e7abc4fb4c6cdcce94895c47"},
+    {102400,
+     "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085"},
+};
+
+// HighwayHash64 of bytes 0, 1, ... 'len' - 1, with kHighwayKey, for each
+// 'len' up to 64, from HighwayHash's highwayhash_test.cc.
+const uint64_t kHighwayKey[4] = {0x0706050403020100, 0x0f0e0d0c0b0a0908,
+                                 0x1716151413121110, 0x1f1e1d1c1b1a1918};
+const uint64_t kHighwayVectors[65] = {
+    0x907A56DE22C26E53, 0x7EAB43AAC7CDDD78, 0xB8D0569AB0B53D62,
+    0x5C6BEFAB8A463D80, 0xF205A46893007EDA, 0x2B8A1668E4A94541,
+    0xBD4CCC325BEFCA6F, 0x4D02AE1738F59482, 0xE1205108E55F3171,
+    0x32D2644EC77A1584, 0xF6E10ACDB103A90B, 0xC3BBF4615B415C15,
+    0x243CC2040063FA9C, 0xA89A58CE65E641FF, 0x24B031A348455A23,
+    0x40793F86A449F33B, 0xCFAB3489F97EB832, 0x19FE67D2C8C5C0E2,
+    0x04DD90A69C565CC2, 0x75D9518E2371C504, 0x38AD9B1141D3DD16,
+    0x0264432CCD8A70E0, 0xA9DB5A6288683390, 0xD7B05492003F028C,
+    0x205F615AEA59E51E, 0xEEE0C89621052884, 0x1BFC1A93A7284F4F,
+    0x512175B5B70DA91D, 0xF71F8976A0A2C639, 0xAE093FEF1F84E3E7,
+    0x22CA92B01161860F, 0x9FC7007CCF035A68, 0xA0C964D9ECD580FC,
+    0x2C90F73CA03181FC, 0x185CF84E5691EB9E, 0x4FC1F5EF2752AA9B,
+    0xF5B7391A5E0A33EB, 0xB9B84B83B4E96C9C, 0x5E42FE712A5CD9B4,
+    0xA150F2F90C3F97DC, 0x7FA522D75E2D637D, 0x181AD0CC0DFFD32B,
+    0x3889ED981E854028, 0xFB4297E8C586EE2D, 0x6D064A45BB28059C,
+    0x90563609B3EC860C, 0x7AA4FCE94097C666, 0x1326BAC06B911E08,
+    0xB926168D2B154F34, 0x9919848945B1948D, 0xA2A98FC534825EBE,
+    0xE9809095213EF0B6, 0x582E5483707BC0E9, 0x086E9414A88A6AF5,
+    0xEE86B98D20F6743D, 0xF89B7FF609B1C0A7, 0x4C7D9CC19E22C3E8,
+    0x9A97005024562A6F, 0x5DD41CF423E6EBEF, 0xDF13609C0468E227,
+    0x6E0DA4F64188155A, 0xB755BA4B50D7D4A1, 0x887A3484647479BD,
+    0xAB8EEBE9BF2139A0, 0x75542C5D4CD2A6FF};
+
+// Largest pieces in which inputs are passed to Update, 0 for all at once.
+const size_t kMaxPieces[] = {0, 1, 63, 1000, 40000};
+
+// Returns bytes 0, 1, ... 250, 0, 1, ..., 'len' in all.
+std::string Input(size_t len) {
+  std::string s(len, 0);
+  for (size_t i = 0; i < len; i++) s[i] = static_cast<char>(i % 251);
+  return s;
+}
+
+std::string Hex(const std::string &s) {
+  std::string h;
+  char b[3];
+  for (unsigned char c : s) {
+    snprintf(b, sizeof(b), "%02x", c);
+    h += b;
+  }
+  return h;
+}
+
+// Names the hash, the implementation and the pieces in mismatch reports.
+std::string Label(const char *hash, const std::string &impl, size_t piece) {
+  return std::string(hash) + " " + impl + " piece " + std::to_string(piece);
+}
+
+void MaybeReportMismatch(const std::string &label, uint64_t got, uint64_t want,
+                         size_t len, int *failures) {
+  if (got == want) return;
+  fprintf(stderr, "%s mismatch: 0x%016llx vs 0x%016llx len %zu\n",
+          label.c_str(), static_cast<unsigned long long>(got),
+          static_cast<unsigned long long>(want), len);
+  (*failures)++;
+}
+
+void MaybeReportMismatch(const std::string &label, const std::string &got,
+                         const std::string &want, size_t len, int *failures) {
+  if (got == want) return;
+  fprintf(stderr, "%s mismatch: %s vs %s len %zu\n", label.c_str(),
+          got.c_str(), want.c_str(), len);
+  (*failures)++;
+}
+
+// Passes 's' to 'h' in pieces of random size up to 'max_piece', or all at
+// once if 'max_piece' is 0.
+template <typename T>
+void UpdatePieces(T *h, const std::string &s, size_t max_piece,
+                  std::knuth_b *rndeng) {
+  if (max_piece == 0) {
+    h->Update(s.data(), s.size());
+    return;
+  }
+  std::uniform_int_distribution<size_t> dist(0, max_piece);
+  for (size_t pos = 0; pos < s.size();) {
+    const size_t k = std::min(dist(*rndeng), s.size() - pos);
+    h->Update(s.data() + pos, k);
+    pos += k;
+  }
+}
+
+// Returns the plain SHA-1 or SHA-256 digest of 's', from OpenSSL.
+std::string OpenSslDigest(cpu_check::ShaLanes::Algorithm algorithm,
+                          const std::string &s) {
+  unsigned char md[SHA256_DIGEST_LENGTH];
+  const auto *p = reinterpret_cast<const unsigned char *>(s.data());
+  if (algorithm == cpu_check::ShaLanes::kSha1) {
+    SHA1(p, s.size(), md);
+    return std::string(reinterpret_cast<char *>(md), SHA_DIGEST_LENGTH);
+  }
+  SHA256(p, s.size(), md);
+  return std::string(reinterpret_cast<char *>(md), SHA256_DIGEST_LENGTH);
+}
+
+// Returns the ShaLanes digest of 's', built from OpenSSL digests of its
+// lanes and tail.
+std::string LanesDigest(cpu_check::ShaLanes::Algorithm algorithm,
+                        const std::string &s) {
+  using cpu_check::ShaLanes;
+  const size_t stripes = s.size() / ShaLanes::kStripeSize;
+  std::string digests;
+  for (int l = 0; l < ShaLanes::kLanes; l++) {
+    std::string lane;
+    for (size_t i = 0; i < stripes; i++) {
+      lane += s.substr(i * ShaLanes::kStripeSize + l * ShaLanes::kBlockSize,
+                       ShaLanes::kBlockSize);
+    }
+    digests += OpenSslDigest(algorithm, lane);
+  }
+  digests +=
+      OpenSslDigest(algorithm, s.substr(stripes * ShaLanes::kStripeSize));
+  return OpenSslDigest(algorithm, digests);
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  int failures = 0;
+  std::knuth_b rndeng((std::random_device()()));
+
+  // Each known vector through each implementation the CPU supports, in
+  // pieces of several sizes.
+  for (SimdIsa isa : cpu_check::SupportedSimdIsas()) {
+    for (size_t piece : kMaxPieces) {
+      for (const Xxh3Vector &v : kXxh3Vectors) {
+        cpu_check::Xxh3 h(isa);
+        UpdatePieces(&h, Input(v.len), piece, &rndeng);
+        MaybeReportMismatch(
+            Label("xxh3", cpu_check::Xxh3::Impl(isa), piece), h.Final(),
+            v.hash, v.len, &failures);
+      }
+
+      for (const Blake3Vector &v : kBlake3Vectors) {
+        cpu_check::Blake3 h(isa);
+        UpdatePieces(&h, Input(v.len), piece, &rndeng);
+        MaybeReportMismatch(
+            Label("blake3", cpu_check::Blake3::Impl(isa), piece),
+            Hex(h.Final()), v.hex, v.len, &failures);
+      }
+
+      for (size_t len = 0; len <= 64; len++) {
+        std::string s(len, 0);
+        for (size_t i = 0; i < len; i++) s[i] = static_cast<char>(i);
+        cpu_check::HighwayHash h(kHighwayKey, isa);
+        UpdatePieces(&h, s, piece, &rndeng);
+        MaybeReportMismatch(
+            Label("highway", cpu_check::HighwayHash::Impl(isa), piece),
+            h.Final(), kHighwayVectors[len], len, &failures);
+      }
+
+      for (auto algorithm :
+           {cpu_check::ShaLanes::kSha1, cpu_check::ShaLanes::kSha256}) {
+        const char *name =
+            algorithm == cpu_check::ShaLanes::kSha1 ? "sha1x16" : "sha256x16";
+        for (size_t len : {0, 1, 1023, 1024, 1025, 16384, 100000}) {
+          const std::string s = Input(len);
+          cpu_check::ShaLanes h(algorithm, isa);
+          UpdatePieces(&h, s, piece, &rndeng);
+          MaybeReportMismatch(
+              Label(name, cpu_check::ShaLanes::Impl(isa), piece),
+              Hex(h.Final()), Hex(LanesDigest(algorithm, s)), len,
+              &failures);
+        }
+      }
+    }
+  }
+
+  // The plain digests the lanes are combined with.
+  for (auto algorithm :
+       {cpu_check::ShaLanes::kSha1, cpu_check::ShaLanes::kSha256}) {
+    for (size_t len : {0, 3, 55, 56, 63, 64, 65, 1000}) {
+      const std::string s = Input(len);
+      MaybeReportMismatch("sha digest",
+                          Hex(cpu_check::ShaLanes::Digest(algorithm, s.data(),
+                                                          s.size())),
+                          Hex(OpenSslDigest(algorithm, s)), len, &failures);
+    }
+  }
+
+  // Random buffers, every implementation matching the scalar one.
+  std::uniform_int_distribution<int> size_dist(1, 262144);
+  std::uniform_int_distribution<int> d_dist(0, 255);
+  std::string buf;
+  for (int i = 0; i < 20; i++) {
+    size_t len = size_dist(rndeng);
+    buf.resize(len);
+    for (size_t j = 0; j < len; j++) buf[j] = static_cast<char>(d_dist(rndeng));
+    cpu_check::Xxh3 xxh3_ref(SimdIsa::kScalar);
+    xxh3_ref.Update(buf.data(), len);
+    const uint64_t xxh3_want = xxh3_ref.Final();
+    cpu_check::Blake3 blake3_ref(SimdIsa::kScalar);
+    blake3_ref.Update(buf.data(), len);
+    const std::string blake3_want = Hex(blake3_ref.Final());
+    cpu_check::HighwayHash highway_ref(kHighwayKey, SimdIsa::kScalar);
+    highway_ref.Update(buf.data(), len);
+    const uint64_t highway_want = highway_ref.Final();
+    for (SimdIsa isa : cpu_check::SupportedSimdIsas()) {
+      cpu_check::Xxh3 xxh3(isa);
+      UpdatePieces(&xxh3, buf, 5000, &rndeng);
+      MaybeReportMismatch(Label("xxh3", cpu_check::Xxh3::Impl(isa), 5000),
+                          xxh3.Final(), xxh3_want, len, &failures);
+      cpu_check::Blake3 blake3(isa);
+      UpdatePieces(&blake3, buf, 5000, &rndeng);
+      MaybeReportMismatch(
+          Label("blake3", cpu_check::Blake3::Impl(isa), 5000),
+          Hex(blake3.Final()), blake3_want, len, &failures);
+      cpu_check::HighwayHash highway(kHighwayKey, isa);
+      UpdatePieces(&highway, buf, 5000, &rndeng);
+      MaybeReportMismatch(
+          Label("highway", cpu_check::HighwayHash::Impl(isa), 5000),
+          highway.Final(), highway_want, len, &failures);
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -14,6 +14,9 @@
 
 #include "hasher.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "crc32c.h"
 #include "utils.h"
 #include "third_party/farmhash/src/farmhash.h"
@@ -35,46 +38,278 @@ std::string OpenSSL_Hash(const MalignBuffer &s, const EVP_MD *type) {
   EVP_MD_CTX_destroy(ctx);
   return HexStr(hash);
 }
+
+class OpenSSLState : public HashState {
+ public:
+  explicit OpenSSLState(const EVP_MD *type) : ctx_(EVP_MD_CTX_create()) {
+    EVP_DigestInit_ex(ctx_, type, nullptr);
+  }
+  ~OpenSSLState() override { EVP_MD_CTX_destroy(ctx_); }
+
+  void Update(const char *p, size_t n) override {
+    EVP_DigestUpdate(ctx_, p, n);
+  }
+
+  std::string Final() override {
+    std::string hash;
+    hash.resize(EVP_MD_CTX_size(ctx_));
+    MalignBuffer::InitializeMemoryForSanitizer(hash.data(), hash.size());
+    EVP_DigestFinal_ex(ctx_, (uint8_t *)&hash[0], nullptr);
+    return HexStr(hash);
+  }
+
+ private:
+  EVP_MD_CTX *const ctx_;
+};
+
+// State of a checksum 'T' extended by 'extend'.
+template <typename T, T (*extend)(T, const char *, size_t)>
+class ChecksumState : public HashState {
+ public:
+  explicit ChecksumState(T initial) : c_(initial) {}
+
+  void Update(const char *p, size_t n) override { c_ = extend(c_, p, n); }
+
+  std::string Final() override {
+    return HexData(reinterpret_cast<const char *>(&c_), sizeof(c_));
+  }
+
+ private:
+  T c_;
+};
+
+uLong Adler32Extend(uLong c, const char *p, size_t n) {
+  return adler32(c, reinterpret_cast<const Bytef *>(p), n);
+}
+
+uLong Crc32Extend(uLong c, const char *p, size_t n) {
+  return crc32(c, reinterpret_cast<const Bytef *>(p), n);
+}
+
+uint64_t FarmHashChain(uint64_t c, const char *p, size_t n) {
+  return util::Hash64WithSeed(p, n, c);
+}
+
+// State of a streaming hash 'T', whose Final returns a 64 bit hash or a
+// binary digest.
+template <typename T>
+class StreamState : public HashState {
+ public:
+  template <typename... Args>
+  explicit StreamState(Args &&...args) : t_(std::forward<Args>(args)...) {}
+
+  void Update(const char *p, size_t n) override { t_.Update(p, n); }
+
+  std::string Final() override { return Digest(t_.Final()); }
+
+ private:
+  static std::string Digest(uint64_t c) {
+    return HexData(reinterpret_cast<const char *>(&c), sizeof(c));
+  }
+  static std::string Digest(const std::string &d) { return HexStr(d); }
+
+  T t_;
+};
+
+// The reference implementation's test key.
+constexpr uint64_t kHighwayKey[4] = {0x0706050403020100, 0x0f0e0d0c0b0a0908,
+                                     0x1716151413121110, 0x1f1e1d1c1b1a1918};
+
+// Returns the Final digest of 's' updated with all of 'b'.
+std::string HashAll(std::unique_ptr<HashState> s, const MalignBuffer &b) {
+  s->Update(b.data(), b.size());
+  return s->Final();
+}
+
+class MultiState : public HashState {
+ public:
+  // Size of blocks fed to each hasher in turn, small enough to stay in L1.
+  static constexpr size_t kBlockSize = 8192;
+
+  // Uses the hashers' states for 'isa'.
+  MultiState(const std::vector<std::unique_ptr<Hasher>> &hashers,
+             SimdIsa isa) {
+    for (const auto &h : hashers) states_.push_back(h->NewStateWith(isa));
+  }
+
+  void Update(const char *p, size_t n) override {
+    for (size_t pos = 0; pos < n; pos += kBlockSize) {
+      const size_t k = std::min(kBlockSize, n - pos);
+      for (const auto &s : states_) s->Update(p + pos, k);
+    }
+  }
+
+  // Returns the hashers' digests, separated by '/'.
+  std::string Final() override {
+    std::string hash;
+    for (const auto &s : states_) {
+      if (!hash.empty()) hash += '/';
+      hash += s->Final();
+    }
+    return hash;
+  }
+
+ private:
+  std::vector<std::unique_ptr<HashState>> states_;
+};
 }  // namespace
 
 std::string Md5::Hash(const MalignBuffer &b) const {
   return OpenSSL_Hash(b, EVP_md5());
 }
 
+std::unique_ptr<HashState> Md5::NewState() const {
+  return std::make_unique<OpenSSLState>(EVP_md5());
+}
+
 std::string Sha1::Hash(const MalignBuffer &b) const {
   return OpenSSL_Hash(b, EVP_sha1());
 }
 
+std::unique_ptr<HashState> Sha1::NewState() const {
+  return std::make_unique<OpenSSLState>(EVP_sha1());
+}
+
 std::string Sha256::Hash(const MalignBuffer &b) const {
   return OpenSSL_Hash(b, EVP_sha256());
 }
 
+std::unique_ptr<HashState> Sha256::NewState() const {
+  return std::make_unique<OpenSSLState>(EVP_sha256());
+}
+
 std::string Sha512::Hash(const MalignBuffer &b) const {
   return OpenSSL_Hash(b, EVP_sha512());
 }
 
+std::unique_ptr<HashState> Sha512::NewState() const {
+  return std::make_unique<OpenSSLState>(EVP_sha512());
+}
+
 std::string Adler32::Hash(const MalignBuffer &b) const {
   uLong c = adler32(0, Z_NULL, 0);
   c = adler32(c, reinterpret_cast<const Bytef *>(b.data()), b.size());
   return HexData(reinterpret_cast<const char *>(&c), sizeof(c));
 }
 
+std::unique_ptr<HashState> Adler32::NewState() const {
+  return std::make_unique<ChecksumState<uLong, Adler32Extend>>(
+      adler32(0, Z_NULL, 0));
+}
+
 std::string Crc32::Hash(const MalignBuffer &b) const {
   uLong c = crc32(0, Z_NULL, 0);
   c = crc32(c, reinterpret_cast<const Bytef *>(b.data()), b.size());
   return HexData(reinterpret_cast<const char *>(&c), sizeof(c));
 }
 
+std::unique_ptr<HashState> Crc32::NewState() const {
+  return std::make_unique<ChecksumState<uLong, Crc32Extend>>(
+      crc32(0, Z_NULL, 0));
+}
+
 std::string Crc32C::Hash(const MalignBuffer &b) const {
   const uint32_t c = crc32c(b.data(), b.size());
   return HexData(reinterpret_cast<const char *>(&c), sizeof(c));
 }
 
+std::unique_ptr<HashState> Crc32C::NewState() const {
+  return std::make_unique<ChecksumState<uint32_t, crc32c_extend>>(0);
+}
+
 std::string FarmHash64::Hash(const MalignBuffer &b) const {
   const uint64_t c = util::Hash64(b.data(), b.size());
   return HexData(reinterpret_cast<const char *>(&c), sizeof(c));
 }
 
+std::unique_ptr<HashState> FarmHash64::NewState() const {
+  return std::make_unique<ChecksumState<uint64_t, FarmHashChain>>(0);
+}
+
+std::string ShaLanesHasher::Name() const {
+  return algorithm_ == ShaLanes::kSha1 ? "SHA1x16" : "SHA256x16";
+}
+
+std::string ShaLanesHasher::Hash(const MalignBuffer &b) const {
+  return HashAll(NewState(), b);
+}
+
+std::unique_ptr<HashState> ShaLanesHasher::NewState() const {
+  return NewStateWith(SimdIsa::kAvx512);
+}
+
+std::string ShaLanesHasher::HashWith(const MalignBuffer &b, SimdIsa isa) const {
+  return HashAll(NewStateWith(isa), b);
+}
+
+std::unique_ptr<HashState> ShaLanesHasher::NewStateWith(SimdIsa isa) const {
+  return std::make_unique<StreamState<ShaLanes>>(algorithm_, isa);
+}
+
+std::string Xxh3Hasher::Hash(const MalignBuffer &b) const {
+  return HashAll(NewState(), b);
+}
+
+std::unique_ptr<HashState> Xxh3Hasher::NewState() const {
+  return NewStateWith(SimdIsa::kAvx512);
+}
+
+std::string Xxh3Hasher::HashWith(const MalignBuffer &b, SimdIsa isa) const {
+  return HashAll(NewStateWith(isa), b);
+}
+
+std::unique_ptr<HashState> Xxh3Hasher::NewStateWith(SimdIsa isa) const {
+  return std::make_unique<StreamState<Xxh3>>(isa);
+}
+
+std::string HighwayHasher::Hash(const MalignBuffer &b) const {
+  return HashAll(NewState(), b);
+}
+
+std::unique_ptr<HashState> HighwayHasher::NewState() const {
+  return NewStateWith(SimdIsa::kAvx512);
+}
+
+std::string HighwayHasher::HashWith(const MalignBuffer &b, SimdIsa isa) const {
+  return HashAll(NewStateWith(isa), b);
+}
+
+std::unique_ptr<HashState> HighwayHasher::NewStateWith(SimdIsa isa) const {
+  return std::make_unique<StreamState<HighwayHash>>(kHighwayKey, isa);
+}
+
+std::string Blake3Hasher::Hash(const MalignBuffer &b) const {
+  return HashAll(NewState(), b);
+}
+
+std::unique_ptr<HashState> Blake3Hasher::NewState() const {
+  return NewStateWith(SimdIsa::kAvx512);
+}
+
+std::string Blake3Hasher::HashWith(const MalignBuffer &b, SimdIsa isa) const {
+  return HashAll(NewStateWith(isa), b);
+}
+
+std::unique_ptr<HashState> Blake3Hasher::NewStateWith(SimdIsa isa) const {
+  return std::make_unique<StreamState<Blake3>>(isa);
+}
+
+std::string MultiHasher::Hash(const MalignBuffer &b) const {
+  return HashAll(NewState(), b);
+}
+
+std::unique_ptr<HashState> MultiHasher::NewState() const {
+  return NewStateWith(SimdIsa::kAvx512);
+}
+
+std::string MultiHasher::HashWith(const MalignBuffer &b, SimdIsa isa) const {
+  return HashAll(NewStateWith(isa), b);
+}
+
+std::unique_ptr<HashState> MultiHasher::NewStateWith(SimdIsa isa) const {
+  return std::make_unique<MultiState>(hashers_, isa);
+}
+
 Hashers::Hashers() {
   hashers_.emplace_back(new Md5);
   hashers_.emplace_back(new Sha1);
@@ -84,6 +319,11 @@ Hashers::Hashers() {
   hashers_.emplace_back(new Crc32);
   hashers_.emplace_back(new Crc32C);
   hashers_.emplace_back(new FarmHash64);
+  hashers_.emplace_back(new ShaLanesHasher(ShaLanes::kSha1));
+  hashers_.emplace_back(new ShaLanesHasher(ShaLanes::kSha256));
+  hashers_.emplace_back(new Xxh3Hasher);
+  hashers_.emplace_back(new HighwayHasher);
+  hashers_.emplace_back(new Blake3Hasher);
 }
 
 const Hasher &Hashers::RandomHasher(uint64_t seed) const {
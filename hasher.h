@@ -19,63 +19,164 @@
 #include <string>
 #include <vector>
 
+#include "blake3.h"
+#include "highway_hash.h"
 #include "malign_buffer.h"
+#include "sha_lanes.h"
+#include "simd_isa.h"
+#include "xxh3.h"
 
 namespace cpu_check {
 
+// Digest of data fed to it piece by piece.
+class HashState {
+ public:
+  virtual ~HashState() {}
+  virtual void Update(const char *p, size_t n) = 0;
+  // Returns digest of all data passed to Update.
+  virtual std::string Final() = 0;
+};
+
 class Hasher {
  public:
   virtual ~Hasher() {}
   virtual std::string Name() const = 0;
   virtual std::string Hash(const MalignBuffer &b) const = 0;
+  // Returns a HashState whose Final digest of a buffer's contents matches
+  // Hash of the buffer, save where noted.
+  virtual std::unique_ptr<HashState> NewState() const = 0;
+
+  // Returns Hash of 'b' as computed with the vector instructions of 'isa',
+  // for hashers with an implementation per instruction set, so that a round
+  // may hash and check with different ones. By default just Hash.
+  virtual std::string HashWith(const MalignBuffer &b, SimdIsa isa) const {
+    return Hash(b);
+  }
+  // As NewState, but for HashWith.
+  virtual std::unique_ptr<HashState> NewStateWith(SimdIsa isa) const {
+    return NewState();
+  }
 };
 
 class Md5 : public Hasher {
  public:
   std::string Name() const override { return "MD5"; }
   std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
 };
 
 class Sha1 : public Hasher {
  public:
   std::string Name() const override { return "SHA1"; }
   std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
 };
 
 class Sha256 : public Hasher {
  public:
   std::string Name() const override { return "SHA256"; }
   std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
 };
 
 class Sha512 : public Hasher {
  public:
   std::string Name() const override { return "SHA512"; }
   std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
 };
 
 class Adler32 : public Hasher {
  public:
   std::string Name() const override { return "ADLER32"; }
   std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
 };
 
 class Crc32 : public Hasher {
  public:
   std::string Name() const override { return "CRC32"; }
   std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
 };
 
 class Crc32C : public Hasher {
  public:
   std::string Name() const override { return "CRC32C"; }
   std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
 };
 
 class FarmHash64 : public Hasher {
  public:
   std::string Name() const override { return "FarmHash64"; }
   std::string Hash(const MalignBuffer &b) const override;
+  // FarmHash has no incremental form, so the state chains the hashes of the
+  // pieces, each seeding the next, and its digest differs from Hash's.
+  std::unique_ptr<HashState> NewState() const override;
+};
+
+// SHA-1 or SHA-256 of 16 interleaved lanes of the buffer, hashed in lockstep
+// in AVX2 or AVX-512 registers, see ShaLanes.
+class ShaLanesHasher : public Hasher {
+ public:
+  explicit ShaLanesHasher(ShaLanes::Algorithm algorithm)
+      : algorithm_(algorithm) {}
+  std::string Name() const override;
+  std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
+  std::string HashWith(const MalignBuffer &b, SimdIsa isa) const override;
+  std::unique_ptr<HashState> NewStateWith(SimdIsa isa) const override;
+
+ private:
+  const ShaLanes::Algorithm algorithm_;
+};
+
+// XXH3, with SSE2, AVX2 and AVX-512 accumulators, see Xxh3.
+class Xxh3Hasher : public Hasher {
+ public:
+  std::string Name() const override { return "XXH3"; }
+  std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
+  std::string HashWith(const MalignBuffer &b, SimdIsa isa) const override;
+  std::unique_ptr<HashState> NewStateWith(SimdIsa isa) const override;
+};
+
+// HighwayHash with a fixed key, in AVX2 registers, see HighwayHash.
+class HighwayHasher : public Hasher {
+ public:
+  std::string Name() const override { return "HighwayHash64"; }
+  std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
+  std::string HashWith(const MalignBuffer &b, SimdIsa isa) const override;
+  std::unique_ptr<HashState> NewStateWith(SimdIsa isa) const override;
+};
+
+// BLAKE3, hashing chunks of the buffer in SIMD lanes, see Blake3.
+class Blake3Hasher : public Hasher {
+ public:
+  std::string Name() const override { return "BLAKE3"; }
+  std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
+  std::string HashWith(const MalignBuffer &b, SimdIsa isa) const override;
+  std::unique_ptr<HashState> NewStateWith(SimdIsa isa) const override;
+};
+
+// Digests of all of several Hashers, computed in one pass that feeds each
+// block of the buffer to every hasher while the block is cached.
+class MultiHasher : public Hasher {
+ public:
+  // Keeps a reference to 'hashers'.
+  explicit MultiHasher(const std::vector<std::unique_ptr<Hasher>> &hashers)
+      : hashers_(hashers) {}
+  std::string Name() const override { return "ALL"; }
+  std::string Hash(const MalignBuffer &b) const override;
+  std::unique_ptr<HashState> NewState() const override;
+  std::string HashWith(const MalignBuffer &b, SimdIsa isa) const override;
+  std::unique_ptr<HashState> NewStateWith(SimdIsa isa) const override;
+
+ private:
+  const std::vector<std::unique_ptr<Hasher>> &hashers_;
 };
 
 class Hashers {
@@ -85,12 +186,16 @@ class Hashers {
   // Returns a randomly selected hasher.
   const Hasher &RandomHasher(uint64_t seed) const;
 
+  // Returns a hasher computing the digests of all the others.
+  const Hasher &AllHasher() const { return all_; }
+
   const std::vector<std::unique_ptr<Hasher>> &hashers() const {
     return hashers_;
   }
 
  private:
   std::vector<std::unique_ptr<Hasher>> hashers_;
+  const MultiHasher all_{hashers_};
 };
 }  // namespace cpu_check
 #endif  // THIRD_PARTY_CPU_CHECK_HASH_H_
@@ -0,0 +1,200 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "highway_hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define X86_TARGET_ATTRIBUTE(s) __attribute__((target(s)))
+#else
+#define X86_TARGET_ATTRIBUTE(s)
+#endif
+
+namespace cpu_check {
+namespace {
+
+using State = HighwayHash::State;
+
+constexpr uint64_t kInit0[4] = {0xdbe6d5d5fe4cce2f, 0xa4093822299f31d0,
+                                0x13198a2e03707344, 0x243f6a8885a308d3};
+constexpr uint64_t kInit1[4] = {0x3bd39e10cb0ef593, 0xc0acf169b5f18a8c,
+                                0xbe5466cf34e90c6c, 0x452821e638d01377};
+
+typedef uint64_t Lanes4 __attribute__((vector_size(32)));
+typedef uint8_t Bytes32 __attribute__((vector_size(32)));
+
+// Adds the bytes of 'v1' and 'v0' to 'add1' and 'add0', shuffled so that
+// multiplication results spread to where they'll be multiplied again.
+void ZipperMergeAndAdd(uint64_t v1, uint64_t v0, uint64_t* add1,
+                       uint64_t* add0) {
+  *add0 += (((v0 & 0xff000000) | (v1 & 0xff00000000)) >> 24) |
+           (((v0 & 0xff0000000000) | (v1 & 0xff000000000000)) >> 16) |
+           (v0 & 0xff0000) | ((v0 & 0xff00) << 32) |
+           ((v1 & 0xff00000000000000) >> 8) | (v0 << 56);
+  *add1 += (((v1 & 0xff000000) | (v0 & 0xff00000000)) >> 24) |
+           (v1 & 0xff0000) | ((v1 & 0xff0000000000) >> 16) |
+           ((v1 & 0xff00) << 24) | ((v0 & 0xff000000000000) >> 8) |
+           ((v1 & 0xff) << 48) | (v0 & 0xff00000000000000);
+}
+
+void ScalarUpdate(State* s, const char* p, size_t packets) {
+  for (size_t k = 0; k < packets; k++, p += HighwayHash::kPacketSize) {
+    for (int i = 0; i < 4; i++) {
+      uint64_t lane;
+      memcpy(&lane, p + 8 * i, sizeof(lane));
+      s->v1[i] += s->mul0[i] + lane;
+      s->mul0[i] ^= (s->v1[i] & 0xffffffff) * (s->v0[i] >> 32);
+      s->v0[i] += s->mul1[i];
+      s->mul1[i] ^= (s->v0[i] & 0xffffffff) * (s->v1[i] >> 32);
+    }
+    ZipperMergeAndAdd(s->v1[1], s->v1[0], &s->v0[1], &s->v0[0]);
+    ZipperMergeAndAdd(s->v1[3], s->v1[2], &s->v0[3], &s->v0[2]);
+    ZipperMergeAndAdd(s->v0[1], s->v0[0], &s->v1[1], &s->v1[0]);
+    ZipperMergeAndAdd(s->v0[3], s->v0[2], &s->v1[3], &s->v1[2]);
+  }
+}
+
+// As ZipperMergeAndAdd's shuffle, within each 128 bit half.
+X86_TARGET_ATTRIBUTE("avx2")
+Lanes4 ZipperMerge(Lanes4 v) {
+  const Bytes32 kShuffle = {3,  12, 2,  5,  14, 1,  15, 0,  11, 4,  10,
+                            13, 9,  6,  8,  7,  19, 28, 18, 21, 30, 17,
+                            31, 16, 27, 20, 26, 29, 25, 22, 24, 23};
+  return reinterpret_cast<Lanes4>(
+      __builtin_shuffle(reinterpret_cast<Bytes32>(v), kShuffle));
+}
+
+X86_TARGET_ATTRIBUTE("avx2")
+void Avx2Update(State* s, const char* p, size_t packets) {
+  Lanes4 v0, v1, mul0, mul1;
+  memcpy(&v0, s->v0, sizeof(v0));
+  memcpy(&v1, s->v1, sizeof(v1));
+  memcpy(&mul0, s->mul0, sizeof(mul0));
+  memcpy(&mul1, s->mul1, sizeof(mul1));
+  for (size_t k = 0; k < packets; k++, p += HighwayHash::kPacketSize) {
+    Lanes4 lanes;
+    memcpy(&lanes, p, sizeof(lanes));
+    v1 += mul0 + lanes;
+    mul0 ^= (v1 & 0xffffffff) * (v0 >> 32);
+    v0 += mul1;
+    mul1 ^= (v0 & 0xffffffff) * (v1 >> 32);
+    v0 += ZipperMerge(v1);
+    v1 += ZipperMerge(v0);
+  }
+  memcpy(s->v0, &v0, sizeof(v0));
+  memcpy(s->v1, &v1, sizeof(v1));
+  memcpy(s->mul0, &mul0, sizeof(mul0));
+  memcpy(s->mul1, &mul1, sizeof(mul1));
+}
+
+struct UpdateImpl {
+  HighwayHash::UpdateFn update;
+  const char* name;
+};
+
+// Returns the widest implementation no wider than 'isa' that this CPU
+// supports. There is none for SSE2, nor any wider than AVX2.
+const UpdateImpl& Select(SimdIsa isa) {
+  static const UpdateImpl impls[] = {
+      {ScalarUpdate, "scalar"},
+      {ScalarUpdate, "scalar"},
+      {Avx2Update, "avx2"},
+      {Avx2Update, "avx2"},
+  };
+  return impls[static_cast<int>(SupportedSimdIsa(isa))];
+}
+
+// Rotates each 32 bit half of each lane left by 'count', in [1, 31].
+void Rotate32By(int count, uint64_t lanes[4]) {
+  for (int i = 0; i < 4; i++) {
+    const uint32_t half0 = lanes[i];
+    const uint32_t half1 = lanes[i] >> 32;
+    lanes[i] = ((half0 << count) | (half0 >> (32 - count))) |
+               static_cast<uint64_t>((half1 << count) |
+                                     (half1 >> (32 - count)))
+                   << 32;
+  }
+}
+
+}  // namespace
+
+HighwayHash::HighwayHash(const uint64_t key[4], SimdIsa isa)
+    : update_(Select(isa).update) {
+  for (int i = 0; i < 4; i++) {
+    state_.mul0[i] = kInit0[i];
+    state_.mul1[i] = kInit1[i];
+    state_.v0[i] = kInit0[i] ^ key[i];
+    state_.v1[i] = kInit1[i] ^ ((key[i] >> 32) | (key[i] << 32));
+  }
+}
+
+void HighwayHash::Update(const char* p, size_t n) {
+  if (buffered_) {
+    const size_t k = std::min(n, kPacketSize - buffered_);
+    memcpy(buffer_ + buffered_, p, k);
+    buffered_ += k;
+    p += k;
+    n -= k;
+    if (buffered_ < kPacketSize) return;
+    update_(&state_, buffer_, 1);
+    buffered_ = 0;
+  }
+  const size_t packets = n / kPacketSize;
+  update_(&state_, p, packets);
+  p += packets * kPacketSize;
+  n -= packets * kPacketSize;
+  memcpy(buffer_, p, n);
+  buffered_ = n;
+}
+
+uint64_t HighwayHash::Final() {
+  // A partial packet is padded, with some of its bytes moved about, and its
+  // size mixed into the state.
+  if (buffered_) {
+    const size_t size_mod4 = buffered_ & 3;
+    const char* remainder = buffer_ + (buffered_ & ~3);
+    char packet[kPacketSize] = {};
+    for (int i = 0; i < 4; i++) {
+      state_.v0[i] += (static_cast<uint64_t>(buffered_) << 32) + buffered_;
+    }
+    Rotate32By(buffered_, state_.v1);
+    memcpy(packet, buffer_, remainder - buffer_);
+    if (buffered_ & 16) {
+      for (int i = 0; i < 4; i++) {
+        packet[28 + i] = remainder[i + size_mod4 - 4];
+      }
+    } else if (size_mod4) {
+      packet[16] = remainder[0];
+      packet[17] = remainder[size_mod4 >> 1];
+      packet[18] = remainder[size_mod4 - 1];
+    }
+    update_(&state_, packet, 1);
+  }
+  for (int n = 0; n < 4; n++) {
+    // Updates with v0's lanes permuted, and their halves swapped.
+    uint64_t permuted[4];
+    for (int i = 0; i < 4; i++) {
+      const uint64_t v = state_.v0[(i + 2) % 4];
+      permuted[i] = (v >> 32) | (v << 32);
+    }
+    update_(&state_, reinterpret_cast<const char*>(permuted), 1);
+  }
+  return state_.v0[0] + state_.v1[0] + state_.mul0[0] + state_.mul1[0];
+}
+
+std::string HighwayHash::Impl(SimdIsa isa) { return Select(isa).name; }
+
+}  // namespace cpu_check
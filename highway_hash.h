@@ -0,0 +1,69 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CPU_CHECK_HIGHWAY_HASH_H_
+#define THIRD_PARTY_CPU_CHECK_HIGHWAY_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "simd_isa.h"
+
+namespace cpu_check {
+
+// Streaming keyed HighwayHash, 64 bit result, matching the reference
+// implementation's HighwayHash64.
+//
+// Its state is four 64 bit lanes of each of four vectors, updated by 32 bit
+// multiplies and byte shuffles a 32 byte packet at a time, in AVX2 registers.
+class HighwayHash {
+ public:
+  static constexpr size_t kPacketSize = 32;
+
+  struct State {
+    uint64_t v0[4];
+    uint64_t v1[4];
+    uint64_t mul0[4];
+    uint64_t mul1[4];
+  };
+
+  // Updates 'state' with 'packets' packets at 'p'.
+  using UpdateFn = void (*)(State* state, const char* p, size_t packets);
+
+  // Updates the state with AVX2 if 'isa' is at least that wide and the CPU
+  // supports it, else one lane at a time with scalar code.
+  HighwayHash(const uint64_t key[4], SimdIsa isa);
+
+  HighwayHash(const HighwayHash&) = delete;
+  HighwayHash& operator=(const HighwayHash&) = delete;
+
+  void Update(const char* p, size_t n);
+
+  // Returns the hash of everything passed to Update.
+  uint64_t Final();
+
+  // Returns name of the implementation used for 'isa': "avx2" or "scalar".
+  static std::string Impl(SimdIsa isa = SimdIsa::kAvx512);
+
+ private:
+  const UpdateFn update_;
+  State state_;
+  char buffer_[kPacketSize];  // A partial packet
+  size_t buffered_ = 0;
+};
+
+}  // namespace cpu_check
+#endif  // THIRD_PARTY_CPU_CHECK_HIGHWAY_HASH_H_
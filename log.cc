@@ -0,0 +1,271 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "log.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Single-producer single-consumer byte ring holding whole lines written by
+// one thread, awaiting the drainer.
+class LogRing {
+ public:
+  static constexpr size_t kSize = 1 << 17;
+
+  // Appends 'line' and a newline. Returns false, appending nothing, if there
+  // isn't room. Producer only.
+  bool Push(const std::string& line) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    const uint64_t tail = tail_.load(std::memory_order_acquire);
+    if (line.size() + 1 > kSize - (head - tail)) return false;
+    Copy(head, line.data(), line.size());
+    Copy(head + line.size(), "\n", 1);
+    head_.store(head + line.size() + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns true if Push of a 'n' byte line could never succeed.
+  static bool TooBig(size_t n) { return n + 1 > kSize / 4; }
+
+  // Appends to 'iov' up to two pieces covering the unconsumed bytes, and
+  // returns their total length. Consumer only.
+  size_t Peek(std::vector<struct iovec>* iov) const {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const size_t n = head - tail;
+    const size_t start = tail % kSize;
+    const size_t first = std::min(n, kSize - start);
+    if (first) iov->push_back({const_cast<char*>(buf_ + start), first});
+    if (n > first) iov->push_back({const_cast<char*>(buf_), n - first});
+    return n;
+  }
+
+  // Releases 'n' bytes seen by Peek. Consumer only.
+  void Consume(size_t n) {
+    tail_.store(tail_.load(std::memory_order_relaxed) + n,
+                std::memory_order_release);
+  }
+
+  std::atomic<uint64_t> dropped = 0;  // Lines that didn't fit
+  uint64_t reported_dropped = 0;      // Consumer only
+
+ private:
+  void Copy(uint64_t pos, const char* p, size_t n) {
+    const size_t start = pos % kSize;
+    const size_t first = std::min(n, kSize - start);
+    memcpy(buf_ + start, p, first);
+    memcpy(buf_, p + first, n - first);
+  }
+
+  char buf_[kSize];
+  alignas(64) std::atomic<uint64_t> head_ = 0;  // Next byte to produce
+  alignas(64) std::atomic<uint64_t> tail_ = 0;  // Next byte to consume
+};
+
+// Owns the LogRings, one per thread that has logged, and the thread that
+// drains them to stdout. Never destroyed, so it may be used to the very end.
+class LogBackend {
+ public:
+  static LogBackend* Get() {
+    static LogBackend* backend = new LogBackend();
+    return backend;
+  }
+
+  // Returns the calling thread's LogRing. Rings outlive their threads, so
+  // that nothing logged is lost.
+  LogRing* MyRing() {
+    thread_local LogRing* ring = nullptr;
+    if (ring == nullptr) {
+      ring = new LogRing();
+      std::lock_guard<std::mutex> l(rings_mu_);
+      rings_.push_back(ring);
+    }
+    return ring;
+  }
+
+  // Writes everything queued so far.
+  void Flush() {
+    std::lock_guard<std::mutex> l(drain_mu_);
+    while (Drain(Rings())) {
+    }
+  }
+
+  // As Flush, but gives up rather than wait for a lock, whose holder may be
+  // the very thread that crashed. For failure signal handlers.
+  void TryFlush() {
+    std::unique_lock<std::mutex> d(drain_mu_, std::try_to_lock);
+    if (!d.owns_lock()) return;
+    std::unique_lock<std::mutex> r(rings_mu_, std::try_to_lock);
+    if (!r.owns_lock()) return;
+    const std::vector<LogRing*> rings = rings_;
+    r.unlock();
+    while (Drain(rings)) {
+    }
+  }
+
+  // Writes 'line' straight to stdout, after anything already queued.
+  void WriteDirect(const std::string& line) {
+    std::lock_guard<std::mutex> l(drain_mu_);
+    while (Drain(Rings())) {
+    }
+    struct iovec iov[2] = {{const_cast<char*>(line.data()), line.size()},
+                           {const_cast<char*>("\n"), 1}};
+    WriteAll(iov, 2);
+  }
+
+  uint64_t DropCount() {
+    uint64_t n = 0;
+    for (LogRing* r : Rings()) n += r->dropped.load(std::memory_order_relaxed);
+    return n;
+  }
+
+ private:
+  // How long the drainer idles when there's nothing to write.
+  static constexpr int kIdleMicros = 1000;
+
+  LogBackend() {
+    atexit([] { LogBackend::Get()->Flush(); });
+    std::thread([this] { Run(); }).detach();
+  }
+
+  std::vector<LogRing*> Rings() {
+    std::lock_guard<std::mutex> l(rings_mu_);
+    return rings_;
+  }
+
+  void Run() {
+    while (true) {
+      bool wrote;
+      {
+        std::lock_guard<std::mutex> l(drain_mu_);
+        wrote = Drain(Rings());
+      }
+      if (!wrote) usleep(kIdleMicros);
+    }
+  }
+
+  // Writes, with as few writev calls as possible, whatever 'rings' held on
+  // entry, followed by reports of lines they dropped. Returns false if there
+  // was nothing to write. The reports are written here rather than logged,
+  // as logging from a thread whose ring is full would wait on the drainer.
+  // REQUIRES drain_mu_ held.
+  bool Drain(const std::vector<LogRing*>& rings) {
+    std::vector<struct iovec> iov;
+    std::vector<std::pair<LogRing*, size_t>> spans;
+    for (LogRing* r : rings) {
+      const size_t n = r->Peek(&iov);
+      if (n) spans.emplace_back(r, n);
+    }
+    std::vector<std::string> reports;
+    for (LogRing* r : rings) {
+      const uint64_t dropped = r->dropped.load(std::memory_order_relaxed);
+      if (dropped != r->reported_dropped) {
+        reports.push_back("Log dropped " +
+                          std::to_string(dropped - r->reported_dropped) +
+                          " lines for lack of buffer space\n");
+        r->reported_dropped = dropped;
+      }
+    }
+    for (std::string& report : reports) {
+      iov.push_back({report.data(), report.size()});
+    }
+    if (iov.empty()) return false;
+    WriteAll(iov.data(), iov.size());
+    for (auto [r, n] : spans) r->Consume(n);
+    return !spans.empty();
+  }
+
+  // Writes all of 'iov', retrying partial writes, a batch of IOV_MAX at a
+  // time. Gives up on output errors other than EINTR.
+  static void WriteAll(struct iovec* iov, size_t n) {
+    while (n) {
+      const ssize_t w =
+          writev(STDOUT_FILENO, iov, std::min<size_t>(n, IOV_MAX));
+      if (w < 0) {
+        if (errno == EINTR) continue;
+        return;
+      }
+      size_t done = w;
+      while (n && done >= iov->iov_len) {
+        done -= iov->iov_len;
+        iov++;
+        n--;
+      }
+      if (n) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+        iov->iov_len -= done;
+      }
+    }
+  }
+
+  std::mutex rings_mu_;  // Guards rings_, taken once per thread by producers
+  std::vector<LogRing*> rings_;
+  std::mutex drain_mu_;  // Held while writing, so lines go out whole
+};
+
+}  // namespace
+
+void LogWrite(LOG_LEVEL lvl, const std::string& line) {
+  // How long to wait for room for WARN and above before dropping them.
+  constexpr int kMaxWaitMicros = 10000;
+  constexpr int kWaitStepMicros = 100;
+
+  LogBackend* backend = LogBackend::Get();
+  if (LogRing::TooBig(line.size())) {
+    backend->WriteDirect(line);
+    return;
+  }
+  LogRing* ring = backend->MyRing();
+  for (int waited = 0; !ring->Push(line); waited += kWaitStepMicros) {
+    if (lvl < WARN || waited >= kMaxWaitMicros) {
+      if (lvl >= ERROR) {
+        // Too important to drop: corruption reports, or the reason for a
+        // FATAL abort.
+        backend->WriteDirect(line);
+      } else {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+      return;
+    }
+    usleep(kWaitStepMicros);
+  }
+}
+
+void LogFlush() { LogBackend::Get()->Flush(); }
+
+void LogFailureWriter(const char* data) {
+  LogBackend::Get()->TryFlush();
+  if (data == nullptr) return;
+  for (size_t n = strlen(data); n;) {
+    const ssize_t w = write(STDERR_FILENO, data, n);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    data += w;
+    n -= w;
+  }
+}
+
+uint64_t LogDropCount() { return LogBackend::Get()->DropCount(); }
@@ -17,12 +17,12 @@
 
 #include <sys/time.h>
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
 #include <atomic>
-#include <iostream>
 #include <sstream>
 #include <string>
 
@@ -57,6 +57,24 @@ enum LOG_LEVEL {
 
 static LOG_LEVEL min_log_level = INFO;
 
+// Queues 'line' (sans newline) for output to stdout by a background thread.
+// Each thread's lines stay in order, but may interleave out of time order
+// with other threads'. Lock free unless 'line' is huge. If the calling
+// thread's buffer is full, waits a while for room for WARN and above, then
+// drops a WARN line, or writes an ERROR or FATAL one directly.
+void LogWrite(LOG_LEVEL lvl, const std::string& line);
+
+// Writes all queued lines before returning. Called on exit and FATAL.
+void LogFlush();
+
+// For absl::FailureSignalHandlerOptions::writerfn: writes what lines are
+// queued, if it can without waiting for a lock, then 'data', if not null, to
+// stderr.
+void LogFailureWriter(const char* data);
+
+// Returns the number of lines dropped for lack of buffer space.
+uint64_t LogDropCount();
+
 class Log {
  public:
   Log(const char* file, int line, LOG_LEVEL lvl) : lvl_(lvl) {
@@ -99,10 +117,9 @@ class Log {
 
   ~Log() {
     if (skip_) return;
-    // You might prefer to direct errors to stderr, e.g.
-    //   (lvl_ < WARN ? std::cout : std::cerr) << os_.str();
-    std::cout << os_.str() << std::endl;
+    LogWrite(lvl_, os_.str());
     if (lvl_ == FATAL) {
+      LogFlush();
       abort();
     }
   }
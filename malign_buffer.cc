@@ -20,9 +20,15 @@
 #include <immintrin.h>
 #endif
 
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#endif
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <iomanip>
 #include <sstream>
@@ -108,8 +114,120 @@ inline void __avx_512_memcpy(char *dst, const char *src, size_t size) {
   LOG(FATAL) << "x86 only";
 #endif
 }
+
+// Mismatch finders return the offset of the first, or last, byte at which
+// 'a' and 'b' differ, or 'n' if they are the same.
+struct MismatchFinder {
+  size_t (*first)(const char *a, const char *b, size_t n);
+  size_t (*last)(const char *a, const char *b, size_t n);
+  const char *name;
+};
+
+size_t ScalarFirstMismatch(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  while (i < n && a[i] == b[i]) i++;
+  return i;
+}
+
+size_t ScalarLastMismatch(const char *a, const char *b, size_t n) {
+  for (size_t i = n; i > 0; i--) {
+    if (a[i - 1] != b[i - 1]) return i - 1;
+  }
+  return n;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+X86_TARGET_ATTRIBUTE("avx2")
+uint32_t Avx2DiffMask(const char *a, const char *b) {
+  const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+  const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+  return ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+}
+
+X86_TARGET_ATTRIBUTE("avx2")
+size_t Avx2FirstMismatch(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const uint32_t d = Avx2DiffMask(a + i, b + i);
+    if (d) return i + __builtin_ctz(d);
+  }
+  return i + ScalarFirstMismatch(a + i, b + i, n - i);
+}
+
+X86_TARGET_ATTRIBUTE("avx2")
+size_t Avx2LastMismatch(const char *a, const char *b, size_t n) {
+  size_t i = n;
+  for (; i >= 32; i -= 32) {
+    const uint32_t d = Avx2DiffMask(a + i - 32, b + i - 32);
+    if (d) return i - 1 - __builtin_clz(d);
+  }
+  const size_t r = ScalarLastMismatch(a, b, i);
+  return r == i ? n : r;
+}
+
+X86_TARGET_ATTRIBUTE("avx512bw")
+uint64_t Avx512DiffMask(const char *a, const char *b) {
+  return _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(a), _mm512_loadu_si512(b));
+}
+
+X86_TARGET_ATTRIBUTE("avx512bw")
+size_t Avx512FirstMismatch(const char *a, const char *b, size_t n) {
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    const uint64_t d = Avx512DiffMask(a + i, b + i);
+    if (d) return i + __builtin_ctzll(d);
+  }
+  return i + ScalarFirstMismatch(a + i, b + i, n - i);
+}
+
+X86_TARGET_ATTRIBUTE("avx512bw")
+size_t Avx512LastMismatch(const char *a, const char *b, size_t n) {
+  size_t i = n;
+  for (; i >= 64; i -= 64) {
+    const uint64_t d = Avx512DiffMask(a + i - 64, b + i - 64);
+    if (d) return i - 1 - __builtin_clzll(d);
+  }
+  const size_t r = ScalarLastMismatch(a, b, i);
+  return r == i ? n : r;
+}
+#endif
+
+// Returns the widest MismatchFinder no wider than 'isa' that this CPU
+// supports. There is none for SSE2, and the AVX-512 one needs AVX-512BW.
+const MismatchFinder *SelectMismatch(SimdIsa isa) {
+  static const MismatchFinder finders[] = {
+      {ScalarFirstMismatch, ScalarLastMismatch, "scalar"},
+      {ScalarFirstMismatch, ScalarLastMismatch, "scalar"},
+#if defined(__i386__) || defined(__x86_64__)
+      {Avx2FirstMismatch, Avx2LastMismatch, "avx2"},
+      {Avx512FirstMismatch, Avx512LastMismatch, "avx512"},
+#endif
+  };
+  isa = SupportedSimdIsa(isa);
+#if defined(__i386__) || defined(__x86_64__)
+  if (isa == SimdIsa::kAvx512 && !__builtin_cpu_supports("avx512bw")) {
+    isa = SimdIsa::kAvx2;
+  }
+#endif
+  return &finders[static_cast<int>(isa)];
+}
+
+// As last set by LimitCompareIsa, or null for the widest.
+std::atomic<const MismatchFinder *> mismatch_limit{nullptr};
+
+const MismatchFinder &Mismatch() {
+  static const MismatchFinder *const widest = SelectMismatch(SimdIsa::kAvx512);
+  const MismatchFinder *f = mismatch_limit.load(std::memory_order_relaxed);
+  return f ? *f : *widest;
+}
 }  // namespace
 
+void MalignBuffer::LimitCompareIsa(SimdIsa isa) {
+  mismatch_limit.store(SelectMismatch(isa), std::memory_order_relaxed);
+}
+
+std::string MalignBuffer::CompareImpl() { return Mismatch().name; }
+
 size_t MalignBuffer::RoundUpToPageSize(size_t k) {
   return ((k + kPageSize - 1) / kPageSize) * kPageSize;
 }
@@ -149,10 +267,17 @@ size_t MalignBuffer::RandomAlignment(uint64_t seed) {
   return std::uniform_int_distribution<size_t>(0, kPageSize - 1)(rng);
 }
 
-MalignBuffer::MalignBuffer(size_t capacity)
-    : capacity_(capacity),
-      base_address_(
-          aligned_alloc(kPageSize, RoundUpToPageSize(capacity) + kPageSize)) {
+// Buffers given a NUMA policy are mapped, not taken from the heap, so that
+// the policy applies to their pages alone and goes when they do.
+MalignBuffer::MalignBuffer(size_t capacity, bool mapped)
+    : capacity_(capacity), mapped_(mapped) {
+  if (mapped_) {
+    base_address_ = mmap(nullptr, MappedSize(capacity), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base_address_ == MAP_FAILED) base_address_ = nullptr;
+  } else {
+    base_address_ = aligned_alloc(kPageSize, MappedSize(capacity));
+  }
   if (base_address_ == nullptr) {
     LOG(FATAL) << "Failed allocate for capacity: " << capacity;
   }
@@ -166,7 +291,13 @@ MalignBuffer::MalignBuffer(size_t alignment_offset, absl::string_view s)
   CopyFrom(s, kMemcpy);
 }
 
-MalignBuffer::~MalignBuffer() { free(base_address_); }
+MalignBuffer::~MalignBuffer() {
+  if (mapped_) {
+    munmap(base_address_, MappedSize(capacity_));
+  } else {
+    free(base_address_);
+  }
+}
 
 void MalignBuffer::Initialize(size_t alignment_offset, size_t length) {
   if (length > capacity_) {
@@ -186,15 +317,29 @@ void MalignBuffer::resize(size_t length) {
 }
 
 std::string MalignBuffer::CopyFrom(const MalignBuffer &that, CopyMethod m) {
-  CopyFrom(absl::string_view(that.data(), that.size()), m);
+  // Source and destination blocks fit together in L1, so each block is
+  // compared while still cached, rather than streamed in again afterwards.
+  constexpr size_t kBlockSize = 16 * 1024;
+  CheckEqualSize(absl::string_view(that.data(), that.size()));
+  bool mismatch = false;
+  for (size_t pos = 0; pos < size(); pos += kBlockSize) {
+    const size_t n = std::min(kBlockSize, size() - pos);
+    CopyFrom(pos, absl::string_view(that.data() + pos, n), m);
+    mismatch |= Mismatch().first(data() + pos, that.data() + pos, n) != n;
+  }
+  if (!mismatch) return "";
   return Syndrome(that);
 }
 
 void MalignBuffer::CopyFrom(absl::string_view src, CopyMethod m) {
+  CheckEqualSize(src);
+  CopyFrom(0, src, m);
+}
+
+void MalignBuffer::CheckEqualSize(absl::string_view src) const {
   if (size() != src.size()) {
     LOG(FATAL) << "this.size: " << size() << " src.size:" << src.size();
   }
-  CopyFrom(0, src, m);
 }
 
 void MalignBuffer::CopyFrom(size_t pos, absl::string_view src, CopyMethod m) {
@@ -223,8 +368,20 @@ void MalignBuffer::CopyFrom(size_t pos, absl::string_view src, CopyMethod m) {
 }
 
 std::string MalignBuffer::Syndrome(const MalignBuffer &that) const {
+  return Syndrome(0, size(), that);
+}
+
+std::string MalignBuffer::Syndrome(size_t offset,
+                                   const MalignBuffer &that) const {
+  const size_t length =
+      offset < size() ? std::min(that.size(), size() - offset) : 0;
+  return Syndrome(offset, length, that);
+}
+
+std::string MalignBuffer::Syndrome(size_t offset, size_t length,
+                                   const MalignBuffer &that) const {
   std::stringstream s;
-  std::string syndrome = CorruptionSyndrome(that);
+  std::string syndrome = CorruptionSyndrome(offset, length, that);
   if (syndrome.empty()) return "";
   s << syndrome << ", \"this\": \"" << static_cast<const void *>(data())
     << "\", "
@@ -232,14 +389,23 @@ std::string MalignBuffer::Syndrome(const MalignBuffer &that) const {
   return s.str();
 }
 
-std::string MalignBuffer::CorruptionSyndrome(const MalignBuffer &that) const {
+std::string MalignBuffer::CorruptionSyndrome(size_t offset, size_t length,
+                                             const MalignBuffer &that) const {
   std::stringstream s;
-  if (size() != that.size()) {
-    s << Json("unequalSizeThis", size()) << ", "
+  if (length != that.size()) {
+    s << Json("unequalSizeThis", length) << ", "
       << Json("unequalSizeThat", that.size());
     return s.str();
   }
-  bool failed_memcmp = memcmp(data(), that.data(), that.size());
+  const char *const mine = data() + offset;
+  // One vectorized pass settles the common, equal case. Only a mismatching
+  // range gets the detailed, bytewise treatment, and a memcmp to cross-check
+  // the vector compare.
+  const size_t first = Mismatch().first(mine, that.data(), length);
+  if (first == length) return "";
+  const size_t last = Mismatch().last(mine, that.data(), length);
+  const bool failed_memcmp =
+      memcmp(mine + first, that.data() + first, last - first + 1);
 
   int wrong_bytes = 0;
   int wrong_bits = 0;
@@ -247,8 +413,8 @@ std::string MalignBuffer::CorruptionSyndrome(const MalignBuffer &that) const {
   int first_wrong = INT_MAX;
   int last_wrong = INT_MIN;
   std::vector<int> lane_errors(8, 0);
-  for (size_t i = 0; i < size(); i++) {
-    unsigned char a = *(data() + i);
+  for (size_t i = first; i <= last; i++) {
+    unsigned char a = *(mine + i);
     unsigned char b = *(that.data() + i);
     unsigned char d = a ^ b;
     if (d) {
@@ -271,7 +437,7 @@ std::string MalignBuffer::CorruptionSyndrome(const MalignBuffer &that) const {
       << ", " << Json("wrongByteCount", wrong_bytes) << ", "
       << Json("wrongBitCount", wrong_bits) << ", "
       << Json("corruptionWidth", range_width) << ", "
-      << Json("corruptStart", first_wrong) << ", "
+      << Json("corruptStart", offset + first_wrong) << ", "
       << Json("corruptByteBitMask", byte_faults) << ", "
       << "\"byBitLane\": [";
     for (size_t i = 0; i < 8; i++) {
@@ -285,14 +451,14 @@ std::string MalignBuffer::CorruptionSyndrome(const MalignBuffer &that) const {
     uint64_t buf_a = 0;
     uint64_t buf_b = 0;
     for (size_t k = 0; k < std::min(64, range_width); k++) {
-      uint8_t a = *(data() + first_wrong + k);
+      uint8_t a = *(mine + first_wrong + k);
       uint8_t b = *(that.data() + first_wrong + k);
       if (k) dump << ", ";
       dump << "[ " << std::setw(2) << "\"0x" << static_cast<int>(a) << "\", "
            << std::setw(2) << "\"0x" << static_cast<int>(b) << "\" ";
       buf_a = (buf_a >> 8) | static_cast<uint64_t>(a) << 56;
       buf_b = (buf_b >> 8) | static_cast<uint64_t>(b) << 56;
-      if ((k >= 7) && (7 == ((first_wrong + k) % 8))) {
+      if ((k >= 7) && (7 == ((offset + first_wrong + k) % 8))) {
         dump << ", " << CrackId(buf_a) << ", " << CrackId(buf_b);
         buf_a = 0;
         buf_b = 0;
@@ -302,8 +468,9 @@ std::string MalignBuffer::CorruptionSyndrome(const MalignBuffer &that) const {
     dump << " ] ";
     return s.str() + ", " + dump.str();
   } else {
-    if (!failed_memcmp) return "";
-    return Json("cmpResult", "**Failed_Memcmp**");
+    // The vector compare saw a difference the bytewise one didn't.
+    return Json("cmpResult",
+                failed_memcmp ? "**Failed_Memcmp**" : "**Failed_VectorCmp**");
   }
 }
 
@@ -369,6 +536,35 @@ void MalignBuffer::MadviseDontNeed() const {
   }
 }
 
+void MalignBuffer::SetNumaNodes(const std::vector<int> &nodes) {
+  if (nodes == numa_nodes_) return;
+  if (!mapped_) {
+    LOG(FATAL) << "NUMA nodes set on a heap buffer";
+  }
+#ifdef __linux__
+  constexpr int kBitsPerWord = 8 * sizeof(unsigned long);
+  int max_node = 0;
+  for (int n : nodes) max_node = std::max(max_node, n);
+  std::vector<unsigned long> mask(max_node / kBitsPerWord + 1);
+  for (int n : nodes) mask[n / kBitsPerWord] |= 1ul << (n % kBitsPerWord);
+  int mode = MPOL_INTERLEAVE;
+  if (nodes.size() < 2) mode = nodes.empty() ? MPOL_DEFAULT : MPOL_BIND;
+  // The mapping is ours alone. The kernel reads one fewer than 'maxnode' bits
+  // of the mask.
+  if (syscall(SYS_mbind, base_address_, MappedSize(capacity_), mode,
+              nodes.empty() ? nullptr : mask.data(),
+              nodes.empty() ? 0 : mask.size() * kBitsPerWord + 1,
+              nodes.empty() ? 0 : MPOL_MF_MOVE) == -1) {
+    LOG_EVERY_N_SECS(WARN, 60)
+        << "mbind failed: " << strerror(errno) << " nodes: " << nodes.size();
+    return;
+  }
+  numa_nodes_ = nodes;
+#else
+  LOG_EVERY_N_SECS(WARN, 60) << "NUMA placement unsupported on this platform";
+#endif
+}
+
 MalignBuffer::PunchedHole MalignBuffer::RandomPunchedHole(uint64_t seed) const {
   std::knuth_b rng(seed);
   MalignBuffer::PunchedHole hole;
@@ -17,8 +17,10 @@
 
 #include <random>
 #include <string>
+#include <vector>
 
 #include "absl/strings/string_view.h"
+#include "simd_isa.h"
 
 namespace cpu_check {
 
@@ -50,11 +52,21 @@ class MalignBuffer {
   // Returns a random alignment offset in range [0..kPageSize-1].
   static size_t RandomAlignment(uint64_t seed);
 
+  // Limits the vector compares of Syndrome and the validated CopyFrom to
+  // those of 'isa', or the widest the CPU supports below it, for testing
+  // each implementation. By default the widest is used.
+  static void LimitCompareIsa(SimdIsa isa);
+
+  // Returns the name of the compare implementation in use: "avx512", "avx2" or
+  // "scalar".
+  static std::string CompareImpl();
+
   // Helper to make MSAN happy. NOP if memory sanitizer is not enabled.
   static void InitializeMemoryForSanitizer(char* addr, size_t size);
 
-  // Constructs MalignBuffer of specified capacity.
-  MalignBuffer(size_t capacity);
+  // Constructs MalignBuffer of specified capacity, from the heap or, if
+  // 'mapped', in pages of its own, as SetNumaNodes requires.
+  MalignBuffer(size_t capacity, bool mapped = false);
 
   // Constructs and initializes MalignBuffer with specified alignment and
   // content. Useful for unit tests.
@@ -73,16 +85,24 @@ class MalignBuffer {
   const char* data() const { return buffer_address_; }
   char* data() { return buffer_address_; }
   size_t size() const { return length_; }
+  size_t capacity() const { return capacity_; }
+  bool mapped() const { return mapped_; }
 
   // REQUIRES length <= capacity_.
   void resize(size_t length);
 
   // Compares 'this' to 'that' returning empty string if identical.
   // If not identical, returns a syndrome, currently Hamming distance,
-  // corrupted subrange bounds, and the diffs.
+  // corrupted subrange bounds, and the diffs. Identical buffers cost just one
+  // vectorized compare.
   std::string Syndrome(const MalignBuffer& that) const;
 
-  // Validated data copy from source to 'this'.
+  // As Syndrome, but compares 'that' with the part of 'this' at 'offset'.
+  // Reports corruption at offsets within 'this'.
+  std::string Syndrome(size_t offset, const MalignBuffer& that) const;
+
+  // Validated data copy from source to 'this', comparing each block as soon
+  // as it's copied.
   // 'this' must be appropriately sized.
   // Returns syndrome upon copy failure.
   std::string CopyFrom(const MalignBuffer& that, CopyMethod m);
@@ -104,20 +124,39 @@ class MalignBuffer {
   // Hints to the OS to release the buffer's memory.
   void MadviseDontNeed() const;
 
+  // Places the buffer's memory on NUMA 'nodes': bound to the one node,
+  // interleaved across several, or, if empty, wherever first touched.
+  // Migrates pages already present. REQUIRES mapped() unless 'nodes' is
+  // empty.
+  void SetNumaNodes(const std::vector<int>& nodes);
+
   // Returns random PunchedHole within 'this'.
   MalignBuffer::PunchedHole RandomPunchedHole(uint64_t seed) const;
 
  private:
   static size_t RoundUpToPageSize(size_t k);
-  std::string CorruptionSyndrome(const MalignBuffer& that) const;
+  // Returns the size of the allocation holding a buffer of 'capacity' bytes
+  // at any alignment offset.
+  static size_t MappedSize(size_t capacity) {
+    return RoundUpToPageSize(capacity) + kPageSize;
+  }
+  // Dies unless 'src' is the same size as 'this'.
+  void CheckEqualSize(absl::string_view src) const;
+  // Compare 'length' bytes of 'this' at 'offset' with 'that'.
+  std::string Syndrome(size_t offset, size_t length,
+                       const MalignBuffer& that) const;
+  std::string CorruptionSyndrome(size_t offset, size_t length,
+                                 const MalignBuffer& that) const;
   std::string CrackId(uint64_t) const;
 
   const size_t capacity_;
+  const bool mapped_;
   void* base_address_ = nullptr;
 
   size_t alignment_offset_ = 0;
   size_t length_ = 0;  // Usable length
   char* buffer_address_ = nullptr;
+  std::vector<int> numa_nodes_;  // As last set by SetNumaNodes
 };
 
 }  // namespace cpu_check
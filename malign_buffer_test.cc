@@ -0,0 +1,149 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "malign_buffer.h"
+#include "simd_isa.h"
+
+using cpu_check::MalignBuffer;
+using cpu_check::SimdIsa;
+
+namespace {
+// Offsets either side of the vector widths and of CopyFrom's 16 KiB blocks.
+const size_t kFlips[] = {0,     1,     31,    32,    33,    63,    64,
+                         65,    127,   128,   16383, 16384, 16385, 32767,
+                         32768, 32769, 40000, 49151, 49152};
+const size_t kSizes[] = {49153, 65536};
+const size_t kAlignments[] = {0, 1, 63};
+
+void MaybeReportMismatch(const std::string &label, const std::string &got,
+                         const std::string &want, size_t len, int *failures) {
+  if (got == want) return;
+  fprintf(stderr, "%s mismatch: %s vs %s len %zu\n", label.c_str(),
+          got.c_str(), want.c_str(), len);
+  (*failures)++;
+}
+
+std::string Label(const std::string &what, size_t align, size_t pos) {
+  return what + " " + MalignBuffer::CompareImpl() + " align " +
+         std::to_string(align) + " at " + std::to_string(pos);
+}
+
+std::string CorruptStart(size_t pos) {
+  return "\"corruptStart\": " + std::to_string(pos) + ",";
+}
+
+// Returns the Syndrome of 'a' and 'b' from the scalar compare.
+std::string ScalarSyndrome(const MalignBuffer &a, const MalignBuffer &b,
+                           SimdIsa isa) {
+  MalignBuffer::LimitCompareIsa(SimdIsa::kScalar);
+  std::string s = a.Syndrome(b);
+  MalignBuffer::LimitCompareIsa(isa);
+  return s;
+}
+
+// Returns the CopyMethods this CPU supports.
+std::vector<MalignBuffer::CopyMethod> CopyMethods() {
+  std::vector<MalignBuffer::CopyMethod> methods = {MalignBuffer::kMemcpy};
+#if defined(__i386__) || defined(__x86_64__)
+  methods.push_back(MalignBuffer::kRepMov);
+  methods.push_back(MalignBuffer::kSseBy128);
+  if (__builtin_cpu_supports("avx")) methods.push_back(MalignBuffer::kAvxBy256);
+  if (__builtin_cpu_supports("avx512f")) {
+    methods.push_back(MalignBuffer::kAvxBy512);
+  }
+#endif
+  return methods;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  int failures = 0;
+  std::knuth_b rndeng((std::random_device()()));
+  std::uniform_int_distribution<int> d_dist(0, 255);
+  std::string contents(kSizes[1], 0);
+  for (char &c : contents) c = static_cast<char>(d_dist(rndeng));
+
+  for (SimdIsa isa : cpu_check::SupportedSimdIsas()) {
+    MalignBuffer::LimitCompareIsa(isa);
+    for (size_t size : kSizes) {
+      const std::string s = contents.substr(0, size);
+      for (size_t align : kAlignments) {
+        MalignBuffer a(align, s);
+        MalignBuffer b(align, s);
+        MaybeReportMismatch(Label("equal", align, 0), a.Syndrome(b), "",
+                            size, &failures);
+
+        // Single flips, alone and paired with the last byte so the last
+        // mismatch is found too.
+        std::vector<size_t> flips(std::begin(kFlips), std::end(kFlips));
+        flips.push_back(size - 65);
+        flips.push_back(size - 33);
+        flips.push_back(size - 2);
+        flips.push_back(size - 1);
+        for (size_t pos : flips) {
+          b.data()[pos] ^= 0x10;
+          std::string got = a.Syndrome(b);
+          if (got.find(CorruptStart(pos)) == std::string::npos) {
+            MaybeReportMismatch(Label("flip", align, pos), got,
+                                CorruptStart(pos), size, &failures);
+          }
+          MaybeReportMismatch(Label("flip", align, pos), got,
+                              ScalarSyndrome(a, b, isa), size, &failures);
+          b.data()[size - 1] ^= 0x01;
+          MaybeReportMismatch(Label("pair", align, pos), a.Syndrome(b),
+                              ScalarSyndrome(a, b, isa), size, &failures);
+          b.data()[size - 1] ^= 0x01;
+
+          // The same flip seen through a piece of 'a' at 'offset'.
+          const size_t offset = 4096 + align;
+          if (pos >= offset) {
+            MalignBuffer piece(align, s.substr(offset));
+            piece.data()[pos - offset] ^= 0x10;
+            got = a.Syndrome(offset, piece);
+            if (got.find(CorruptStart(pos)) == std::string::npos) {
+              MaybeReportMismatch(Label("piece", align, pos), got,
+                                  CorruptStart(pos), size, &failures);
+            }
+          }
+          b.data()[pos] ^= 0x10;
+        }
+
+        // Validated copies, of sizes just around whole blocks.
+        for (MalignBuffer::CopyMethod m : CopyMethods()) {
+          for (size_t len : {size_t{16383}, size_t{16384}, size_t{16385},
+                             size_t{32768}, size}) {
+            MalignBuffer src(align, s.substr(0, len));
+            MalignBuffer dst(len);
+            dst.Initialize(align ^ 1, len);
+            const std::string label =
+                Label("copy " + MalignBuffer::ToString(m), align, len);
+            MaybeReportMismatch(label, dst.CopyFrom(src, m), "", len,
+                                &failures);
+            MaybeReportMismatch(label, std::string(dst.data(), len),
+                                s.substr(0, len), len, &failures);
+          }
+        }
+      }
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CPU_CHECK_MPSC_QUEUE_H_
+#define THIRD_PARTY_CPU_CHECK_MPSC_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace cpu_check {
+
+// Bounded, lock-free, multi-producer single-consumer queue.
+//
+// Each slot carries a sequence number that tells producers and the consumer
+// whose turn it is (after Vyukov's bounded MPMC queue), so neither side ever
+// blocks the other. Producers contend only on the head index, and the
+// consumer owns the tail outright.
+template <typename T>
+class MpscQueue {
+ public:
+  // Capacity is rounded up to a power of two.
+  explicit MpscQueue(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) n <<= 1;
+    mask_ = n - 1;
+    slots_.reset(new Slot[n]);
+    for (size_t i = 0; i < n; i++) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // Appends 'v', returning false, and leaving 'v' untouched, if full.
+  // Thread safe.
+  bool Push(T&& v) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+      slot = &slots_[pos & mask_];
+      const size_t seq = slot->seq.load(std::memory_order_acquire);
+      const intptr_t dif =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (dif == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;  // Full
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->value = std::move(v);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Removes the oldest entry into '*v', returning false if empty.
+  // Only one thread may consume.
+  bool Pop(T* v) {
+    Slot* slot = &slots_[tail_ & mask_];
+    if (slot->seq.load(std::memory_order_acquire) != tail_ + 1) {
+      return false;
+    }
+    *v = std::move(slot->value);
+    slot->seq.store(tail_ + mask_ + 1, std::memory_order_release);
+    tail_++;
+    return true;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+  alignas(64) std::atomic<size_t> head_ = 0;  // Next slot to produce
+  alignas(64) size_t tail_ = 0;               // Next slot to consume
+};
+
+}  // namespace cpu_check
+#endif  // THIRD_PARTY_CPU_CHECK_MPSC_QUEUE_H_
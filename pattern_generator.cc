@@ -16,10 +16,12 @@
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
-#include <fstream>
+#include <cstring>
 
+#include "counter_rng.h"
 #include "log.h"
 
 namespace cpu_check {
@@ -50,157 +52,358 @@ T ReciprocatedChaos(T v) {
   return Recip(ChaoticF1(Unrecip(v)));
 }
 
-std::vector<std::string> ReadDict() {
-  // Dictionary search paths
-  static const char* dicts[] = {
-      "/usr/share/dict/words",
-      "words",
-  };
-  std::vector<std::string> words;
-  std::ifstream f;
+// Format: 2 bytes of PID, 3 bytes of round number, 3 bytes of offset.
+// Note: Perhaps should be AC-modulated. Perhaps should be absolute aligned
+// for easier recognition.
+// Note: appropriate for LE machines only.
+class SystematicStream : public PatternGenerator::PatternStream {
+ public:
+  SystematicStream(uint64_t round, bool exercise_floating_point)
+      : round_(round),
+        pid_(getpid()),
+        exercise_floating_point_(exercise_floating_point) {
+    fp.d = std::max<uint64_t>(round, 2);
+  }
 
-  for (const auto& d : dicts) {
-    f.open(d, std::ifstream::in);
-    if (f.is_open()) break;
-    f.clear();
+  void Next(size_t offset, MalignBuffer* piece) override {
+    const size_t end = offset + piece->size();
+    for (size_t i = offset / 8; i * 8 < end; i++) {
+      const size_t p = 8 * i - offset;
+      const size_t k = std::min<size_t>(8, piece->size() - p);
+      const uint64_t v = ((pid_ & 0xffff) << 48) |
+                         ((round_ & 0xffffff) << 24) | (i & 0xffffff);
+      for (size_t m = 0; m < k; m++) {
+        (piece->data())[p + m] = *(reinterpret_cast<const char*>(&v) + m);
+      }
+      if (exercise_floating_point_) {
+        fp.d = ReciprocatedChaos<double>(fp.d);
+      }
+    }
   }
 
-  if (!f.is_open()) return words;
+ private:
+  const uint64_t round_;
+  const uint64_t pid_;
+  const bool exercise_floating_point_;
+};
 
-  LOG(DEBUG) << "Reading words.";
+// Random words are generated a block at a time into cached scratch, then
+// copied into the buffer in random one to kMaxSpan byte spans. Byte 'p' is
+// byte p % 8 of word p / 8 of the 'words_' stream, and the spans of the block
+// at 'p' are drawn from the 'spans_' stream at 'p', so any block can be
+// regenerated on its own.
+// Note: appropriate for LE machines only.
+class RandomStream : public PatternGenerator::PatternStream {
+ public:
+  static constexpr size_t kBlockSize = PatternGenerator::kPieceAlign;
 
-  std::string word;
-  while (!f.eof()) {
-    std::getline(f, word);
-    words.push_back(word);
+  RandomStream(uint64_t round, MalignBuffer::CopyMethod copy_method,
+               bool exercise_floating_point)
+      : words_(round),
+        spans_(~round),
+        copy_method_(copy_method),
+        exercise_floating_point_(exercise_floating_point) {
+    fp.f = std::max<uint64_t>(round, 2);
   }
-  f.close();
-  LOG(DEBUG) << "Read " << words.size() << " words.";
-  std::sort(words.begin(), words.end(),
-            [](const std::string& a, const std::string& b) {
-              return a.size() < b.size();
-            });
-  return words;
-}
-}  // namespace
 
-FloatingPointResults FillBufferSystematic::Generate(
-    uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
-    bool exercise_floating_point, MalignBuffer* b) const {
-  const uint64_t pid = getpid();
-
-  // Format: 2 bytes of PID, 3 bytes of round number, 3 bytes of offset.
-  // Note: Perhaps should be AC-modulated. Perhaps should be absolute aligned
-  // for easier recognition.
-  // Note: appropriate for LE machines only.
-  FloatingPointResults fp;
-  fp.d = std::max<uint64_t>(round, 2);
-  for (size_t i = 0; i * 8 < b->size(); i++) {
-    const size_t p = 8 * i;
-    const size_t k = std::min<size_t>(8, b->size() - p);
-    const uint64_t v =
-        ((pid & 0xffff) << 48) | ((round & 0xffffff) << 24) | (i & 0xffffff);
-    for (size_t m = 0; m < k; m++) {
-      (b->data())[p + m] = *(reinterpret_cast<const char*>(&v) + m);
+  void Next(size_t offset, MalignBuffer* piece) override {
+    constexpr size_t kMaxSpan = 256;
+    alignas(64) uint64_t block[kBlockSize / 8];
+    const char* const src = reinterpret_cast<const char*>(block);
+    for (size_t start = 0; start < piece->size(); start += kBlockSize) {
+      const size_t n = std::min(kBlockSize, piece->size() - start);
+      words_.Fill((offset + start) / 8, block, (n + 7) / 8);
+      uint64_t j = offset + start;
+      for (size_t p = 0; p < n;) {
+        const size_t z = std::min<size_t>(n - p, 1 + spans_[j++] % kMaxSpan);
+        piece->CopyFrom(start + p, absl::string_view(src + p, z),
+                        copy_method_);
+        p += z;
+        if (exercise_floating_point_) {
+          fp.f = ReciprocatedChaos<float>(fp.f);
+        }
+      }
     }
-    if (exercise_floating_point) {
-      fp.d = ReciprocatedChaos<double>(fp.d);
+  }
+
+ private:
+  const CounterRng words_;
+  const CounterRng spans_;
+  const MalignBuffer::CopyMethod copy_method_;
+  const bool exercise_floating_point_;
+};
+
+// Words, exponentially distributed over 'dictionary', each followed by a
+// space, and as many spaces as fill the buffer after the last word that fits.
+// Words are staged, contiguously, and copied out a stage at a time.
+class TextStream : public PatternGenerator::PatternStream {
+ public:
+  TextStream(const Dictionary& dictionary, const std::vector<uint32_t>& ranks,
+             uint64_t round, MalignBuffer::CopyMethod copy_method,
+             bool use_repstos, bool exercise_floating_point, size_t size)
+      : dictionary_(dictionary),
+        ranks_(ranks),
+        rng_(round),
+        copy_method_(copy_method),
+        use_repstos_(use_repstos),
+        exercise_floating_point_(exercise_floating_point),
+        size_(size) {
+    fp.ld = std::max<uint64_t>(round, 2);
+  }
+
+  void Next(size_t offset, MalignBuffer* piece) override {
+    const size_t end = offset + piece->size();
+    size_t staged = 0;  // Bytes of stage_, which end at pos_
+    auto Flush = [&]() {
+      if (staged == 0) return;
+      piece->CopyFrom(pos_ - staged - offset,
+                      absl::string_view(stage_, staged), copy_method_);
+      staged = 0;
+    };
+    while (pos_ < end) {
+      // Fast path: short words, with their spaces, well clear of the ends of
+      // the stage and 'piece', copied with a fixed size memcpy.
+      while (!padding_ && pending_.empty() && !space_pending_ &&
+             staged + kShort < kStage && pos_ + kShort < end) {
+        const absl::string_view word = NextWord();
+        if (padding_) break;
+        if (word.size() >= kShort) {
+          pending_ = word;
+          space_pending_ = true;
+          break;
+        }
+        memcpy(stage_ + staged, word.data(), kShort);
+        stage_[staged + word.size()] = ' ';
+        staged += word.size() + 1;
+        pos_ += word.size() + 1;
+      }
+      if (pending_.empty() && !space_pending_) {
+        if (padding_) break;
+        const absl::string_view word = NextWord();
+        if (padding_) break;
+        pending_ = word;
+        space_pending_ = true;
+      }
+      // As much of the word, and its space, as fits the stage and 'piece'.
+      const size_t n = std::min({pending_.size(), end - pos_, kStage - staged});
+      memcpy(stage_ + staged, pending_.data(), n);
+      pending_.remove_prefix(n);
+      staged += n;
+      pos_ += n;
+      if (pending_.empty() && space_pending_ && pos_ < end && staged < kStage) {
+        stage_[staged++] = ' ';
+        space_pending_ = false;
+        pos_++;
+      }
+      if (staged == kStage) Flush();
+    }
+    Flush();
+    if (pos_ < end) {
+      piece->Memset(pos_ - offset, ' ', end - pos_, use_repstos_);
+      pos_ = end;
     }
   }
-  return fp;
-}
 
-FloatingPointResults FillBufferRandom::Generate(
-    uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
-    bool exercise_floating_point, MalignBuffer* b) const {
-  std::knuth_b rng(round);
-  std::uniform_int_distribution<uint64_t> dist(
-      0, std::numeric_limits<uint64_t>::max());
-  FloatingPointResults fp;
-  fp.f = std::max<uint64_t>(round, 2);
-  size_t p = 0;
-  const size_t length = b->size();
-  // Repeatedly append random number (one to eight) random bytes.
-  while (p < length) {
-    const size_t max_span = std::min<size_t>(length - p, 8);
-    const size_t z = std::uniform_int_distribution<size_t>(1, max_span)(rng);
-    const uint64_t v = dist(rng);
-    b->CopyFrom(p, absl::string_view(reinterpret_cast<const char*>(&v), z),
-                copy_method);
-    p += z;
-    if (exercise_floating_point) {
-      fp.f = ReciprocatedChaos<float>(fp.f);
+ private:
+  static constexpr size_t kStage = 4096;
+  // Words shorter than this take the fast path.
+  static constexpr size_t kShort = Dictionary::kReadSlack;
+  // Random draws made at a time.
+  static constexpr size_t kDraws = 256;
+
+  // Returns the next word, or sets padding_ if it would not fit.
+  absl::string_view NextWord() {
+    if (next_draw_ == kDraws) {
+      rng_.Fill(draws_made_, draws_, kDraws);
+      draws_made_ += kDraws;
+      next_draw_ = 0;
+    }
+    const absl::string_view word =
+        dictionary_.word(Rank(draws_[next_draw_++]));
+    if (pos_ + word.size() >= size_) {
+      padding_ = true;
+    } else if (exercise_floating_point_) {
+      fp.ld = ReciprocatedChaos<long double>(fp.ld);
     }
+    return word;
   }
-  return fp;
-}
 
-FloatingPointResults FillBufferText::Generate(
-    uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
-    bool exercise_floating_point, MalignBuffer* b) const {
-  std::knuth_b rng(round);
-  std::exponential_distribution<double> dist(20);
-  FloatingPointResults fp;
-  fp.ld = std::max<uint64_t>(round, 2);
-  const size_t bufsize = b->size();
-  size_t pos = 0;
-  while (pos < bufsize) {
-    const size_t r = std::min(static_cast<size_t>(dist(rng) * words_.size()),
-                              words_.size() - 1);
-    const auto& word = words_[r];
-    const size_t wordlen = word.size();
-    if (pos + wordlen >= bufsize) {
-      break;
+  // Returns rank of the word at uniformly distributed quantile 'u',
+  // interpolating between entries of ranks_.
+  size_t Rank(uint64_t u) const {
+    constexpr size_t kLast = (1 << FillBufferText::kRankBits) - 1;
+    const size_t i = u >> (64 - FillBufferText::kRankBits);
+    if (i == kLast) {
+      // The tail is too long to interpolate.
+      const double q = std::ldexp(static_cast<double>(u), -64);
+      return std::min<double>(-std::log1p(-q) / 20 * dictionary_.size(),
+                              dictionary_.size() - 1);
     }
-    b->CopyFrom(pos, word, copy_method);
-    pos += wordlen;
-    if (pos < bufsize) {
-      b->Memset(pos, ' ', 1, use_repstos);
-      pos++;
+    const uint64_t frac = (u >> (48 - FillBufferText::kRankBits)) & 0xffff;
+    return ranks_[i] + (((ranks_[i + 1] - ranks_[i]) * frac) >> 16);
+  }
+
+  const Dictionary& dictionary_;
+  const std::vector<uint32_t>& ranks_;
+  const CounterRng rng_;
+  const MalignBuffer::CopyMethod copy_method_;
+  const bool use_repstos_;
+  const bool exercise_floating_point_;
+  const size_t size_;
+  uint64_t draws_made_ = 0;       // Words drawn from rng_
+  uint64_t draws_[kDraws];
+  size_t next_draw_ = kDraws;     // Index of next unused draw
+  size_t pos_ = 0;                // Next byte to write
+  absl::string_view pending_;     // Part of word yet to write
+  bool space_pending_ = false;    // Whether a space follows 'pending_'
+  bool padding_ = false;          // Whether past the last word
+  char stage_[kStage];
+};
+
+class GrilledCheeseStream : public PatternGenerator::PatternStream {
+ public:
+  GrilledCheeseStream(uint64_t round, bool use_repstos,
+                      bool exercise_floating_point, size_t size)
+      : rng_(round),
+        use_repstos_(use_repstos),
+        exercise_floating_point_(exercise_floating_point),
+        size_(size) {
+    fp.f = std::max<uint64_t>(round, 2);
+    fp.d = std::max<uint64_t>(round, 2);
+  }
+
+  void Next(size_t offset, MalignBuffer* piece) override {
+    const size_t end = offset + piece->size();
+    piece->Memset(0, 0, piece->size(), use_repstos_);
+    // Stretches reach back at most kWindow from their base, so those with
+    // bases up to end + kWindow may land in 'piece'.
+    for (; base_ < size_ && base_ < end + kWindow; base_ += kAdvance) {
+      if (std::uniform_int_distribution<int>(0, 1)(rng_)) continue;
+      flavor_++;
+      const size_t start =
+          std::uniform_int_distribution<size_t>(base_ - kWindow, base_)(rng_);
+      const size_t last =
+          std::uniform_int_distribution<int>(start, base_)(rng_);
+      stretches_.push_back({start, 1 + last - start, flavor_});
+      if (exercise_floating_point_) {
+        fp.f = ReciprocatedChaos<float>(fp.f);
+        fp.d = ReciprocatedChaos<double>(fp.d);
+      }
     }
-    if (exercise_floating_point) {
-      fp.ld = ReciprocatedChaos<long double>(fp.ld);
+    // In order, as later stretches may overlap earlier ones.
+    for (const Stretch& s : stretches_) {
+      const size_t lo = std::max(s.start, offset);
+      const size_t hi = std::min(s.start + s.length, end);
+      if (lo < hi) piece->Memset(lo - offset, s.v, hi - lo, use_repstos_);
     }
+    stretches_.erase(
+        std::remove_if(stretches_.begin(), stretches_.end(),
+                       [end](const Stretch& s) {
+                         return s.start + s.length <= end;
+                       }),
+        stretches_.end());
   }
-  // Pad with spaces
-  b->Memset(pos, ' ', bufsize - pos, use_repstos);
-  return fp;
-}
 
-FloatingPointResults FillBufferGrilledCheese::Generate(
+ private:
+  static constexpr size_t kAdvance = 15;
+  static constexpr size_t kWindow = 64;
+
+  struct Stretch {
+    size_t start;
+    size_t length;
+    unsigned char v;
+  };
+
+  std::knuth_b rng_;
+  const bool use_repstos_;
+  const bool exercise_floating_point_;
+  const size_t size_;
+  size_t base_ = kWindow;
+  unsigned char flavor_ = 0;
+  // Stretches generated that may yet land in pieces to come.
+  std::vector<Stretch> stretches_;
+};
+}  // namespace
+
+FloatingPointResults PatternGenerator::Generate(
     uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
     bool exercise_floating_point, MalignBuffer* b) const {
-  std::knuth_b rng(round);
-  FloatingPointResults fp;
-  fp.f = std::max<uint64_t>(round, 2);
-  fp.d = std::max<uint64_t>(round, 2);
-  const size_t kAdvance = 15;
-  const size_t kWindow = 64;
-  unsigned char flavor = 0;
-  b->Memset(0, 0, b->size(), use_repstos);
-  for (int base = kWindow; base < b->size(); base += kAdvance) {
-    if (std::uniform_int_distribution<int>(0, 1)(rng)) continue;
-    flavor++;
-    const size_t start =
-        std::uniform_int_distribution<size_t>(base - kWindow, base)(rng);
-    const size_t end = std::uniform_int_distribution<int>(start, base)(rng);
-    b->Memset(start, flavor, 1 + end - start, use_repstos);
-    if (exercise_floating_point) {
-      fp.f = ReciprocatedChaos<float>(fp.f);
-      fp.d = ReciprocatedChaos<double>(fp.d);
-    }
+  std::unique_ptr<PatternStream> s = NewStream(
+      round, copy_method, use_repstos, exercise_floating_point, b->size());
+  s->Next(0, b);
+  return s->fp;
+}
+
+FloatingPointResults PatternGenerator::Stream(
+    uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
+    bool exercise_floating_point, size_t size, MalignBuffer* piece,
+    const PatternSink& sink) const {
+  const size_t piece_size = piece->size();
+  if (piece_size < size && (piece_size == 0 || piece_size % kPieceAlign)) {
+    LOG(FATAL) << "Bad piece size: " << piece_size;
+  }
+  std::unique_ptr<PatternStream> s = NewStream(
+      round, copy_method, use_repstos, exercise_floating_point, size);
+  for (size_t offset = 0; offset < size; offset += piece_size) {
+    piece->resize(std::min(piece_size, size - offset));
+    s->Next(offset, piece);
+    sink(offset, *piece);
+  }
+  return s->fp;
+}
+
+std::unique_ptr<PatternGenerator::PatternStream>
+FillBufferSystematic::NewStream(uint64_t round,
+                                MalignBuffer::CopyMethod copy_method,
+                                bool use_repstos, bool exercise_floating_point,
+                                size_t size) const {
+  return std::make_unique<SystematicStream>(round, exercise_floating_point);
+}
+
+std::unique_ptr<PatternGenerator::PatternStream> FillBufferRandom::NewStream(
+    uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
+    bool exercise_floating_point, size_t size) const {
+  return std::make_unique<RandomStream>(round, copy_method,
+                                        exercise_floating_point);
+}
+
+FillBufferText::FillBufferText(const Dictionary& dictionary)
+    : dictionary_(dictionary), ranks_((1 << kRankBits) + 1) {
+  // Word ranks are exponentially distributed, with mean 1/20 of the words.
+  const size_t n = dictionary_.size();
+  for (size_t i = 0; i < ranks_.size(); i++) {
+    const double q = static_cast<double>(i) / (1 << kRankBits);
+    const double r = -std::log1p(-q) / 20 * n;
+    ranks_[i] = std::min<double>(r, n - 1);
   }
-  return fp;
 }
 
-PatternGenerators::PatternGenerators() : words_(ReadDict()) {
+std::unique_ptr<PatternGenerator::PatternStream> FillBufferText::NewStream(
+    uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
+    bool exercise_floating_point, size_t size) const {
+  return std::make_unique<TextStream>(dictionary_, ranks_, round, copy_method,
+                                      use_repstos, exercise_floating_point,
+                                      size);
+}
+
+std::unique_ptr<PatternGenerator::PatternStream>
+FillBufferGrilledCheese::NewStream(uint64_t round,
+                                   MalignBuffer::CopyMethod copy_method,
+                                   bool use_repstos,
+                                   bool exercise_floating_point,
+                                   size_t size) const {
+  return std::make_unique<GrilledCheeseStream>(round, use_repstos,
+                                               exercise_floating_point, size);
+}
+
+
+PatternGenerators::PatternGenerators() {
   generators_.emplace_back(new FillBufferSystematic());
   generators_.emplace_back(new FillBufferRandom());
 
-  if (!words_.empty()) {
-    generators_.emplace_back(new FillBufferText(words_));
-  } else {
-    LOG(WARN) << "No word list found, skipping Text patterns";
+  const Dictionary& dictionary = Dictionary::Get();
+  if (!dictionary.empty()) {
+    generators_.emplace_back(new FillBufferText(dictionary));
   }
 
   generators_.emplace_back(new FillBufferGrilledCheese());
@@ -223,4 +426,19 @@ FloatingPointResults PatternGenerators::Generate(
   b->PunchHole(hole, use_repstos);
   return f;
 }
+
+FloatingPointResults PatternGenerators::Stream(
+    const PatternGenerator& generator, const MalignBuffer::PunchedHole& hole,
+    uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
+    bool exercise_floating_point, size_t size, MalignBuffer* piece,
+    const PatternSink& sink) const {
+  return generator.Stream(
+      round, copy_method, use_repstos, exercise_floating_point, size, piece,
+      [&](size_t offset, const MalignBuffer& p) {
+        const size_t lo = std::max(hole.start, offset);
+        const size_t hi = std::min(hole.start + hole.length, offset + p.size());
+        if (lo < hi) piece->Memset(lo - offset, hole.v, hi - lo, use_repstos);
+        sink(offset, p);
+      });
+}
 }  // namespace cpu_check
@@ -15,9 +15,12 @@
 #ifndef THIRD_PARTY_CPU_CHECK_PATTERN_GENERATOR_H_
 #define THIRD_PARTY_CPU_CHECK_PATTERN_GENERATOR_H_
 
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "dictionary.h"
 #include "malign_buffer.h"
 
 namespace cpu_check {
@@ -37,16 +40,52 @@ struct FloatingPointResults {
   long double ld = 0.0;
 };
 
+// Consumes successive pieces of a pattern, as written by
+// PatternGenerator::Stream, along with their offsets in the pattern.
+using PatternSink =
+    std::function<void(size_t offset, const MalignBuffer& piece)>;
+
 class PatternGenerator {
  public:
+  // Pieces streamed, save the last, are multiples of this size.
+  static constexpr size_t kPieceAlign = 4096;
+
   virtual ~PatternGenerator() {}
   virtual std::string Name() const = 0;
 
-  virtual FloatingPointResults Generate(uint64_t round,
-                                        MalignBuffer::CopyMethod copy_method,
-                                        bool use_repstos,
-                                        bool exercise_floating_point,
-                                        MalignBuffer*) const = 0;
+  // Fills 'b' with the pattern.
+  FloatingPointResults Generate(uint64_t round,
+                                MalignBuffer::CopyMethod copy_method,
+                                bool use_repstos, bool exercise_floating_point,
+                                MalignBuffer* b) const;
+
+  // Generates the pattern Generate would write to a 'size' byte buffer, a
+  // piece at a time into 'piece', passing each in turn to 'sink'. Pieces are
+  // as long as 'piece' on entry, save perhaps the last, which is resized.
+  // REQUIRES: piece->size() is a multiple of kPieceAlign, or at least 'size'.
+  FloatingPointResults Stream(uint64_t round,
+                              MalignBuffer::CopyMethod copy_method,
+                              bool use_repstos, bool exercise_floating_point,
+                              size_t size, MalignBuffer* piece,
+                              const PatternSink& sink) const;
+
+  // A pattern in the course of generation.
+  class PatternStream {
+   public:
+    virtual ~PatternStream() {}
+
+    // Writes the whole of '*piece', which is the part of the pattern at
+    // 'offset'. Called for successive pieces, in order.
+    virtual void Next(size_t offset, MalignBuffer* piece) = 0;
+
+    FloatingPointResults fp;
+  };
+
+ protected:
+  // Returns the start of a new pattern for a 'size' byte buffer.
+  virtual std::unique_ptr<PatternStream> NewStream(
+      uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
+      bool exercise_floating_point, size_t size) const = 0;
 };
 
 // Fills buffer with a systematic pattern.
@@ -55,22 +94,25 @@ class PatternGenerator {
 class FillBufferSystematic : public PatternGenerator {
  public:
   std::string Name() const override { return "Systematic"; }
-  FloatingPointResults Generate(uint64_t round,
-                                MalignBuffer::CopyMethod copy_method,
-                                bool use_repstos, bool exercise_floating_point,
-                                MalignBuffer*) const override;
+
+ protected:
+  std::unique_ptr<PatternStream> NewStream(
+      uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
+      bool exercise_floating_point, size_t size) const override;
 };
 
-// Fills buffer with a random pattern.
+// Fills buffer with a random pattern, from a counter based generator, copied
+// in random length spans.
 // Returns iterate of chaotic floating point function of 'seed', with some
 // reciprocal torture.
 class FillBufferRandom : public PatternGenerator {
  public:
   std::string Name() const override { return "Random"; }
-  FloatingPointResults Generate(uint64_t round,
-                                MalignBuffer::CopyMethod copy_method,
-                                bool use_repstos, bool exercise_floating_point,
-                                MalignBuffer*) const override;
+
+ protected:
+  std::unique_ptr<PatternStream> NewStream(
+      uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
+      bool exercise_floating_point, size_t size) const override;
 };
 
 // Fills buffer with a compressible pattern.
@@ -78,15 +120,21 @@ class FillBufferRandom : public PatternGenerator {
 // reciprocal torture.
 class FillBufferText : public PatternGenerator {
  public:
-  FillBufferText(const std::vector<std::string>& words) : words_(words) {}
+  // Quantiles of word rank are tabulated at 2^kRankBits points.
+  static constexpr int kRankBits = 12;
+
+  explicit FillBufferText(const Dictionary& dictionary);
   std::string Name() const override { return "Text"; }
-  FloatingPointResults Generate(uint64_t round,
-                                MalignBuffer::CopyMethod copy_method,
-                                bool use_repstos, bool exercise_floating_point,
-                                MalignBuffer*) const override;
+
+ protected:
+  std::unique_ptr<PatternStream> NewStream(
+      uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
+      bool exercise_floating_point, size_t size) const override;
 
  private:
-  const std::vector<std::string>& words_;
+  const Dictionary& dictionary_;
+  // ranks_[i] is the rank of the word at quantile i / 2^kRankBits.
+  std::vector<uint32_t> ranks_;
 };
 
 // memset (conventional or rep;stos) randomly aligned, random width, randomly
@@ -95,10 +143,11 @@ class FillBufferText : public PatternGenerator {
 class FillBufferGrilledCheese : public PatternGenerator {
  public:
   std::string Name() const override { return "Cheese"; }
-  FloatingPointResults Generate(uint64_t round,
-                                MalignBuffer::CopyMethod copy_method,
-                                bool use_repstos, bool exercise_floating_point,
-                                MalignBuffer*) const override;
+
+ protected:
+  std::unique_ptr<PatternStream> NewStream(
+      uint64_t round, MalignBuffer::CopyMethod copy_method, bool use_repstos,
+      bool exercise_floating_point, size_t size) const override;
 };
 
 class PatternGenerators {
@@ -113,10 +162,17 @@ class PatternGenerators {
                                 bool use_repstos, bool exercise_floating_point,
                                 MalignBuffer* b) const;
 
-  const std::vector<std::string>& words() const { return words_; }
+  // As Generate, but streams the pattern, hole included, as
+  // PatternGenerator::Stream does.
+  FloatingPointResults Stream(const PatternGenerator& generator,
+                              const MalignBuffer::PunchedHole& hole,
+                              uint64_t round,
+                              MalignBuffer::CopyMethod copy_method,
+                              bool use_repstos, bool exercise_floating_point,
+                              size_t size, MalignBuffer* piece,
+                              const PatternSink& sink) const;
 
  private:
-  const std::vector<std::string> words_;
   std::vector<std::unique_ptr<PatternGenerator>> generators_;
 };
 }  // namespace cpu_check
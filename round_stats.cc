@@ -0,0 +1,170 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "round_stats.h"
+
+#include <time.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "absl/strings/str_cat.h"
+#include "utils.h"
+
+namespace cpu_check {
+namespace {
+
+// Reference point for TicksPerMicrosecond.
+const uint64_t tick0 = Ticks();
+const double time0 = TimeInSeconds();
+
+}  // namespace
+
+std::string StageName(Stage s) {
+  switch (s) {
+    case kStageAvx:
+      return "avx";
+    case kStageSelfTest:
+      return "selfTest";
+    case kStageSilkscreenWrite:
+      return "silkscreenWrite";
+    case kStageGenerate:
+      return "generate";
+    case kStageHash:
+      return "hash";
+    case kStageCompress:
+      return "compress";
+    case kStageEncrypt:
+      return "encrypt";
+    case kStageCopy:
+      return "copy";
+    case kStageHop:
+      return "hop";
+    case kStageCopyVerify:
+      return "copyVerify";
+    case kStageDecrypt:
+      return "decrypt";
+    case kStageDecompress:
+      return "decompress";
+    case kStageReMake:
+      return "reMake";
+    case kStageRehash:
+      return "rehash";
+    case kStageSilkscreenCheck:
+      return "silkscreenCheck";
+    case kNumStages:
+      break;
+  }
+  return "unknown";
+}
+
+uint64_t Ticks() {
+#if defined(__i386__) || defined(__x86_64__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+double TicksPerMicrosecond() {
+  const double elapsed_us = (TimeInSeconds() - time0) * 1e6;
+  if (elapsed_us <= 0) return 1.0;
+  return (Ticks() - tick0) / elapsed_us;
+}
+
+void LatencyHistogram::MergeFrom(const LatencyHistogram& that) {
+  uint64_t n = 0;
+  for (int k = 0; k < kBuckets; k++) {
+    const uint64_t v = that.buckets_[k].load(std::memory_order_relaxed);
+    RelaxedAdd(&buckets_[k], v);
+    n += v;
+  }
+  // Use the bucket total, rather than that.count_, so that quantiles are
+  // self-consistent even though 'that' may be changing underneath us.
+  RelaxedAdd(&count_, n);
+  RelaxedAdd(&sum_, that.sum());
+}
+
+uint64_t LatencyHistogram::Quantile(double q) const {
+  const uint64_t n = count();
+  if (n == 0) return 0;
+  const uint64_t rank = q * (n - 1);
+  uint64_t seen = 0;
+  for (int k = 0; k < kBuckets; k++) {
+    seen += buckets_[k].load(std::memory_order_relaxed);
+    if (seen > rank) return 2ull << k;
+  }
+  return 2ull << (kBuckets - 1);
+}
+
+void StageHistograms::MergeFrom(const StageHistograms& that) {
+  for (int s = 0; s < kNumStages; s++) {
+    histograms_[s].MergeFrom(that.histograms_[s]);
+  }
+}
+
+std::string StageHistograms::Json() const {
+  const double ticks_per_us = TicksPerMicrosecond();
+  uint64_t total = 0;
+  for (const auto& h : histograms_) total += h.sum();
+
+  std::string s;
+  for (int i = 0; i < kNumStages; i++) {
+    const LatencyHistogram& h = histograms_[i];
+    if (!h.count()) continue;
+    const double mean_us = h.sum() / ticks_per_us / h.count();
+    if (!s.empty()) s += ", ";
+    s += JsonRecord(
+        StageName(static_cast<Stage>(i)),
+        absl::StrCat(::Json("n", h.count()), ", ", ::Json("mean_us", mean_us),
+                     ", ", ::Json("p50_us", h.Quantile(0.5) / ticks_per_us),
+                     ", ", ::Json("p99_us", h.Quantile(0.99) / ticks_per_us),
+                     ", ",
+                     ::Json("share", total ? 1.0 * h.sum() / total : 0.0)));
+  }
+  return s;
+}
+
+void RoundCounters::MergeFrom(const RoundCounters& that) {
+  RelaxedAdd(&rounds_, that.rounds());
+  RelaxedAdd(&successes_, that.successes());
+  for (int s = 0; s < kNumStages; s++) {
+    RelaxedAdd(&failures_[s], that.failures(static_cast<Stage>(s)));
+  }
+}
+
+uint64_t RoundCounters::failures() const {
+  uint64_t n = 0;
+  for (const auto& f : failures_) n += f.load(std::memory_order_relaxed);
+  return n;
+}
+
+std::string RoundCounters::Json() const {
+  std::string by_stage;
+  for (int i = 0; i < kNumStages; i++) {
+    const uint64_t n = failures(static_cast<Stage>(i));
+    if (!n) continue;
+    if (!by_stage.empty()) by_stage += ", ";
+    by_stage += ::Json(StageName(static_cast<Stage>(i)), n);
+  }
+  return absl::StrCat(::Json("rounds", rounds()), ", ",
+                      ::Json("successes", successes()), ", ",
+                      ::Json("failures", failures()), ", ",
+                      JsonRecord("failuresByStage", by_stage));
+}
+
+}  // namespace cpu_check
@@ -0,0 +1,172 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CPU_CHECK_ROUND_STATS_H_
+#define THIRD_PARTY_CPU_CHECK_ROUND_STATS_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <string>
+
+namespace cpu_check {
+
+// The stages of a Worker round, in the order they are performed.
+enum Stage {
+  kStageAvx,
+  kStageSelfTest,
+  kStageSilkscreenWrite,
+  kStageGenerate,
+  kStageHash,
+  kStageCompress,
+  kStageEncrypt,
+  kStageCopy,
+  kStageHop,
+  kStageCopyVerify,
+  kStageDecrypt,
+  kStageDecompress,
+  kStageReMake,
+  kStageRehash,
+  kStageSilkscreenCheck,
+  kNumStages,
+};
+
+// Returns name of given Stage.
+std::string StageName(Stage s);
+
+// Returns a free running, cheap to read, tick count. On x86 this is the TSC.
+uint64_t Ticks();
+
+// Returns the measured rate of Ticks(), for converting ticks to time.
+double TicksPerMicrosecond();
+
+// Adds 'v' to '*a' without a locked instruction. Only safe if no other
+// thread modifies '*a'.
+inline void RelaxedAdd(std::atomic<uint64_t>* a, uint64_t v) {
+  a->store(a->load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+// Log2 bucketed histogram of tick counts.
+//
+// Add() may only be called by a single owning thread; it uses plain relaxed
+// loads and stores, so recording costs no locked instructions. Other threads
+// may concurrently read a (slightly stale) snapshot with MergeFrom().
+class LatencyHistogram {
+ public:
+  // Bucket k counts samples in [2^k, 2^(k+1)), bucket 0 also counts 0.
+  static constexpr int kBuckets = 48;
+
+  // Records a sample. Owning thread only.
+  void Add(uint64_t ticks) {
+    const int k =
+        ticks ? std::min(kBuckets - 1, 63 - __builtin_clzll(ticks)) : 0;
+    RelaxedAdd(&buckets_[k], 1);
+    RelaxedAdd(&count_, 1);
+    RelaxedAdd(&sum_, ticks);
+  }
+
+  // Accumulates a snapshot of 'that' into 'this'.
+  // REQUIRES 'this' not concurrently updated.
+  void MergeFrom(const LatencyHistogram& that);
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+  // Returns the upper bound, in ticks, of the bucket holding quantile 'q'.
+  uint64_t Quantile(double q) const;
+
+ private:
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_ = {};
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<uint64_t> sum_ = 0;
+};
+
+// A LatencyHistogram per Stage.
+class StageHistograms {
+ public:
+  // Owning thread only.
+  void Add(Stage s, uint64_t ticks) { histograms_[s].Add(ticks); }
+
+  // Accumulates a snapshot of 'that' into 'this'.
+  // REQUIRES 'this' not concurrently updated.
+  void MergeFrom(const StageHistograms& that);
+
+  // Returns JSON fields, one record per stage that has samples, giving
+  // sample count, mean and quantiles in microseconds, and the stage's share
+  // of all recorded time.
+  std::string Json() const;
+
+ private:
+  std::array<LatencyHistogram, kNumStages> histograms_;
+};
+
+// Counts of a Worker's round outcomes, updated like LatencyHistogram by the
+// owning thread alone. Aligned so that no two Workers' counters share a cache
+// line.
+class alignas(64) RoundCounters {
+ public:
+  // Owning thread only.
+  void AddRound() { RelaxedAdd(&rounds_, 1); }
+  void AddSuccess() { RelaxedAdd(&successes_, 1); }
+  void AddFailure(Stage s) { RelaxedAdd(&failures_[s], 1); }
+
+  // Accumulates a snapshot of 'that' into 'this'.
+  // REQUIRES 'this' not concurrently updated.
+  void MergeFrom(const RoundCounters& that);
+
+  uint64_t rounds() const { return rounds_.load(std::memory_order_relaxed); }
+  uint64_t successes() const {
+    return successes_.load(std::memory_order_relaxed);
+  }
+  uint64_t failures(Stage s) const {
+    return failures_[s].load(std::memory_order_relaxed);
+  }
+  // Returns failures summed over all stages.
+  uint64_t failures() const;
+
+  // Returns JSON fields giving the counts, with failures broken down by
+  // stage.
+  std::string Json() const;
+
+ private:
+  std::atomic<uint64_t> rounds_ = 0;
+  std::atomic<uint64_t> successes_ = 0;
+  std::array<std::atomic<uint64_t>, kNumStages> failures_ = {};
+};
+
+// Times successive stages of a round, attributing to each the ticks elapsed
+// since the previous Lap (or construction, or Restart).
+class StageTimer {
+ public:
+  explicit StageTimer(StageHistograms* h) : h_(h), t_(Ticks()) {}
+
+  // Records time since the last lap against 's'.
+  void Lap(Stage s) {
+    const uint64_t t = Ticks();
+    h_->Add(s, t - t_);
+    t_ = t;
+  }
+
+  // Discards time since the last lap.
+  void Restart() { t_ = Ticks(); }
+
+ private:
+  StageHistograms* const h_;
+  uint64_t t_;
+};
+
+}  // namespace cpu_check
+#endif  // THIRD_PARTY_CPU_CHECK_ROUND_STATS_H_
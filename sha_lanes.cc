@@ -0,0 +1,349 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sha_lanes.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define X86_TARGET_ATTRIBUTE(s) __attribute__((target(s)))
+#else
+#define X86_TARGET_ATTRIBUTE(s)
+#endif
+
+namespace cpu_check {
+namespace {
+
+using StripeFn = ShaLanes::StripeFn;
+constexpr int kLanes = ShaLanes::kLanes;
+
+typedef uint32_t Scalar __attribute__((vector_size(4)));
+typedef uint32_t Lanes8 __attribute__((vector_size(32)));
+typedef uint32_t Lanes16 __attribute__((vector_size(64)));
+
+constexpr uint32_t kSha1Init[5] = {0x67452301, 0xefcdab89, 0x98badcfe,
+                                   0x10325476, 0xc3d2e1f0};
+
+constexpr uint32_t kSha256Init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                     0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                     0x1f83d9ab, 0x5be0cd19};
+
+constexpr uint32_t kSha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+inline uint32_t LoadBigEndian(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return __builtin_bswap32(v);
+}
+
+// The vector helpers below are always inlined, so their vector arguments and
+// results never cross a call boundary whose ABI could differ.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+inline void StoreBigEndian(uint32_t v, char* p) {
+  v = __builtin_bswap32(v);
+  memcpy(p, &v, sizeof(v));
+}
+
+template <typename V>
+__attribute__((always_inline)) inline V Rotl(const V& x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+// Gathers word 't' of each lane's block into the lanes of a 'V'.
+template <typename V>
+__attribute__((always_inline)) inline V LoadWord(const char* const* blocks,
+                                                 int t) {
+  constexpr int kWidth = sizeof(V) / sizeof(uint32_t);
+  V w;
+  for (int l = 0; l < kWidth; l++) w[l] = LoadBigEndian(blocks[l] + 4 * t);
+  return w;
+}
+
+// Compresses 'blocks[l]' into lane 'lane0 + l' for each lane of 'V'. Inlined
+// into callers compiled for the instruction set 'V' suits.
+template <typename V>
+__attribute__((always_inline)) inline void Sha1Compress(
+    uint32_t (*h)[kLanes], int lane0, const char* const* blocks) {
+  V s[5];
+  for (int i = 0; i < 5; i++) memcpy(&s[i], &h[i][lane0], sizeof(V));
+  V w[16];
+  for (int t = 0; t < 16; t++) w[t] = LoadWord<V>(blocks, t);
+  V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4];
+  for (int t = 0; t < 80; t++) {
+    if (t >= 16) {
+      w[t % 16] = Rotl(w[(t + 13) % 16] ^ w[(t + 8) % 16] ^ w[(t + 2) % 16] ^
+                           w[t % 16],
+                       1);
+    }
+    V f;
+    uint32_t k;
+    if (t < 20) {
+      f = d ^ (b & (c ^ d));
+      k = 0x5a827999;
+    } else if (t < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    } else if (t < 60) {
+      f = (b & c) | (d & (b | c));
+      k = 0x8f1bbcdc;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+    const V temp = Rotl(a, 5) + f + e + k + w[t % 16];
+    e = d;
+    d = c;
+    c = Rotl(b, 30);
+    b = a;
+    a = temp;
+  }
+  s[0] += a;
+  s[1] += b;
+  s[2] += c;
+  s[3] += d;
+  s[4] += e;
+  for (int i = 0; i < 5; i++) memcpy(&h[i][lane0], &s[i], sizeof(V));
+}
+
+template <typename V>
+__attribute__((always_inline)) inline void Sha256Compress(
+    uint32_t (*h)[kLanes], int lane0, const char* const* blocks) {
+  V s[8];
+  for (int i = 0; i < 8; i++) memcpy(&s[i], &h[i][lane0], sizeof(V));
+  V w[16];
+  for (int t = 0; t < 16; t++) w[t] = LoadWord<V>(blocks, t);
+  V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6],
+    hh = s[7];
+  for (int t = 0; t < 64; t++) {
+    if (t >= 16) {
+      const V w15 = w[(t + 1) % 16];
+      const V w2 = w[(t + 14) % 16];
+      const V s0 = Rotl(w15, 25) ^ Rotl(w15, 14) ^ (w15 >> 3);
+      const V s1 = Rotl(w2, 15) ^ Rotl(w2, 13) ^ (w2 >> 10);
+      w[t % 16] += s0 + w[(t + 9) % 16] + s1;
+    }
+    const V sum1 = Rotl(e, 26) ^ Rotl(e, 21) ^ Rotl(e, 7);
+    const V ch = g ^ (e & (f ^ g));
+    const V t1 = hh + sum1 + ch + kSha256K[t] + w[t % 16];
+    const V sum0 = Rotl(a, 30) ^ Rotl(a, 19) ^ Rotl(a, 10);
+    const V maj = (a & b) | (c & (a | b));
+    hh = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + sum0 + maj;
+  }
+  s[0] += a;
+  s[1] += b;
+  s[2] += c;
+  s[3] += d;
+  s[4] += e;
+  s[5] += f;
+  s[6] += g;
+  s[7] += hh;
+  for (int i = 0; i < 8; i++) memcpy(&h[i][lane0], &s[i], sizeof(V));
+}
+
+// Compresses a block into each of the kLanes lanes, as many at a time as
+// 'V' holds.
+template <typename V>
+__attribute__((always_inline)) inline void Sha1Stripe(
+    uint32_t (*h)[kLanes], const char* const* blocks) {
+  constexpr int kWidth = sizeof(V) / sizeof(uint32_t);
+  for (int l = 0; l < kLanes; l += kWidth) {
+    Sha1Compress<V>(h, l, blocks + l);
+  }
+}
+
+template <typename V>
+__attribute__((always_inline)) inline void Sha256Stripe(
+    uint32_t (*h)[kLanes], const char* const* blocks) {
+  constexpr int kWidth = sizeof(V) / sizeof(uint32_t);
+  for (int l = 0; l < kLanes; l += kWidth) {
+    Sha256Compress<V>(h, l, blocks + l);
+  }
+}
+
+void ScalarSha1(uint32_t (*h)[kLanes], const char* const* blocks) {
+  Sha1Stripe<Scalar>(h, blocks);
+}
+
+void ScalarSha256(uint32_t (*h)[kLanes], const char* const* blocks) {
+  Sha256Stripe<Scalar>(h, blocks);
+}
+
+X86_TARGET_ATTRIBUTE("avx2")
+void Avx2Sha1(uint32_t (*h)[kLanes], const char* const* blocks) {
+  Sha1Stripe<Lanes8>(h, blocks);
+}
+
+X86_TARGET_ATTRIBUTE("avx2")
+void Avx2Sha256(uint32_t (*h)[kLanes], const char* const* blocks) {
+  Sha256Stripe<Lanes8>(h, blocks);
+}
+
+X86_TARGET_ATTRIBUTE("avx512f")
+void Avx512Sha1(uint32_t (*h)[kLanes], const char* const* blocks) {
+  Sha1Stripe<Lanes16>(h, blocks);
+}
+
+X86_TARGET_ATTRIBUTE("avx512f")
+void Avx512Sha256(uint32_t (*h)[kLanes], const char* const* blocks) {
+  Sha256Stripe<Lanes16>(h, blocks);
+}
+
+struct StripeImpl {
+  StripeFn sha1;
+  StripeFn sha256;
+  const char* name;
+};
+
+// Returns the widest implementation no wider than 'isa' that this CPU
+// supports. There is none for SSE2.
+const StripeImpl& Select(SimdIsa isa) {
+  static const StripeImpl impls[] = {
+      {ScalarSha1, ScalarSha256, "scalar"},
+      {ScalarSha1, ScalarSha256, "scalar"},
+      {Avx2Sha1, Avx2Sha256, "avx2"},
+      {Avx512Sha1, Avx512Sha256, "avx512"},
+  };
+  return impls[static_cast<int>(SupportedSimdIsa(isa))];
+}
+
+int Words(ShaLanes::Algorithm algorithm) {
+  return algorithm == ShaLanes::kSha1 ? 5 : 8;
+}
+
+void Init(ShaLanes::Algorithm algorithm, uint32_t (*h)[kLanes]) {
+  const uint32_t* init =
+      algorithm == ShaLanes::kSha1 ? kSha1Init : kSha256Init;
+  for (int i = 0; i < Words(algorithm); i++) {
+    for (int l = 0; l < kLanes; l++) h[i][l] = init[i];
+  }
+}
+
+// Returns the digest held in lane 'l'.
+std::string LaneDigest(ShaLanes::Algorithm algorithm,
+                       const uint32_t (*h)[kLanes], int l) {
+  std::string digest(4 * Words(algorithm), '\0');
+  for (int i = 0; i < Words(algorithm); i++) {
+    StoreBigEndian(h[i][l], &digest[4 * i]);
+  }
+  return digest;
+}
+
+// Writes the padding block that follows a message of 'n' bytes, all of them
+// in blocks already compressed.
+void PaddingBlock(uint64_t n, char* block) {
+  memset(block, 0, ShaLanes::kBlockSize);
+  block[0] = static_cast<char>(0x80);
+  StoreBigEndian(static_cast<uint32_t>((n * 8) >> 32), block + 56);
+  StoreBigEndian(static_cast<uint32_t>(n * 8), block + 60);
+}
+
+}  // namespace
+
+ShaLanes::ShaLanes(Algorithm algorithm, SimdIsa isa)
+    : algorithm_(algorithm),
+      stripe_fn_(algorithm == kSha1 ? Select(isa).sha1 : Select(isa).sha256) {
+  Init(algorithm_, h_);
+}
+
+void ShaLanes::Update(const char* p, size_t n) {
+  const char* blocks[kLanes];
+  while (n) {
+    const char* stripe;
+    if (buffered_ == 0 && n >= kStripeSize) {
+      stripe = p;
+      p += kStripeSize;
+      n -= kStripeSize;
+    } else {
+      const size_t k = std::min(n, kStripeSize - buffered_);
+      memcpy(buffer_ + buffered_, p, k);
+      buffered_ += k;
+      p += k;
+      n -= k;
+      if (buffered_ < kStripeSize) break;
+      stripe = buffer_;
+      buffered_ = 0;
+    }
+    for (int l = 0; l < kLanes; l++) blocks[l] = stripe + l * kBlockSize;
+    stripe_fn_(h_, blocks);
+    stripes_++;
+  }
+}
+
+std::string ShaLanes::Final() {
+  // Every lane holds the same number of whole blocks, so shares the one
+  // padding block.
+  char padding[kBlockSize];
+  PaddingBlock(stripes_ * kBlockSize, padding);
+  const char* blocks[kLanes];
+  for (int l = 0; l < kLanes; l++) blocks[l] = padding;
+  stripe_fn_(h_, blocks);
+
+  std::string digests;
+  for (int l = 0; l < kLanes; l++) digests += LaneDigest(algorithm_, h_, l);
+  digests += Digest(algorithm_, buffer_, buffered_);
+  return Digest(algorithm_, digests.data(), digests.size());
+}
+
+std::string ShaLanes::Impl(SimdIsa isa) { return Select(isa).name; }
+
+std::string ShaLanes::Digest(Algorithm algorithm, const char* p, size_t n) {
+  uint32_t h[8][kLanes];
+  Init(algorithm, h);
+  auto compress = [&](const char* block) {
+    const char* blocks[1] = {block};
+    if (algorithm == kSha1) {
+      Sha1Compress<Scalar>(h, 0, blocks);
+    } else {
+      Sha256Compress<Scalar>(h, 0, blocks);
+    }
+  };
+  const size_t whole = n / kBlockSize;
+  for (size_t i = 0; i < whole; i++) compress(p + i * kBlockSize);
+
+  // The rest of the message, the 0x80 marker and the length may spill into
+  // a second block.
+  char last[2 * kBlockSize] = {};
+  const size_t rest = n - whole * kBlockSize;
+  memcpy(last, p + whole * kBlockSize, rest);
+  char padding[kBlockSize];
+  PaddingBlock(n, padding);
+  last[rest] = padding[0];
+  const size_t end = rest + 1 + 8 <= kBlockSize ? kBlockSize : 2 * kBlockSize;
+  memcpy(last + end - 8, padding + 56, 8);
+  compress(last);
+  if (end > kBlockSize) compress(last + kBlockSize);
+  return LaneDigest(algorithm, h, 0);
+}
+
+}  // namespace cpu_check
@@ -0,0 +1,75 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CPU_CHECK_SHA_LANES_H_
+#define THIRD_PARTY_CPU_CHECK_SHA_LANES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "simd_isa.h"
+
+namespace cpu_check {
+
+// SHA-1 or SHA-256 hashing of kLanes interleaved messages in lockstep, to
+// keep all of the SIMD lanes busy.
+//
+// Successive 64 byte blocks of the input are dealt round robin to the
+// lanes, a stripe of kLanes blocks at a time. A final, partial, stripe is
+// hashed as a separate tail message. The digest is the hash of the lane
+// digests and the tail's digest, concatenated.
+class ShaLanes {
+ public:
+  enum Algorithm { kSha1, kSha256 };
+
+  static constexpr int kLanes = 16;
+  static constexpr size_t kBlockSize = 64;
+  static constexpr size_t kStripeSize = kLanes * kBlockSize;
+
+  // Hashes 16 or 8 lanes at a time with AVX-512 or AVX2, the widest that
+  // 'isa' allows and the CPU supports, else one at a time with scalar code.
+  ShaLanes(Algorithm algorithm, SimdIsa isa);
+
+  ShaLanes(const ShaLanes&) = delete;
+  ShaLanes& operator=(const ShaLanes&) = delete;
+
+  void Update(const char* p, size_t n);
+
+  // Returns the binary digest of everything passed to Update.
+  std::string Final();
+
+  // Returns name of the implementation used for 'isa': "avx512", "avx2" or
+  // "scalar".
+  static std::string Impl(SimdIsa isa = SimdIsa::kAvx512);
+
+  // Returns the plain SHA-1 or SHA-256 digest of 'n' bytes at 'p'.
+  static std::string Digest(Algorithm algorithm, const char* p, size_t n);
+
+  // Compresses block 'blocks[l]' into the state of lane 'l', for each lane.
+  // State word 'i' of lane 'l' is h[i][l].
+  using StripeFn = void (*)(uint32_t (*h)[kLanes], const char* const* blocks);
+
+ private:
+  const Algorithm algorithm_;
+  const StripeFn stripe_fn_;
+  uint32_t h_[8][kLanes];
+  uint64_t stripes_ = 0;  // Stripes compressed
+  char buffer_[kStripeSize];
+  size_t buffered_ = 0;  // Bytes of a partial stripe in buffer_
+};
+
+}  // namespace cpu_check
+#endif  // THIRD_PARTY_CPU_CHECK_SHA_LANES_H_
@@ -0,0 +1,55 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "simd_isa.h"
+
+namespace cpu_check {
+
+std::string ToString(SimdIsa isa) {
+  switch (isa) {
+    case SimdIsa::kScalar:
+      return "scalar";
+    case SimdIsa::kSse2:
+      return "sse2";
+    case SimdIsa::kAvx2:
+      return "avx2";
+    case SimdIsa::kAvx512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+const std::vector<SimdIsa>& SupportedSimdIsas() {
+  static const std::vector<SimdIsa> isas = [] {
+    std::vector<SimdIsa> v = {SimdIsa::kScalar};
+#if defined(__i386__) || defined(__x86_64__)
+    if (__builtin_cpu_supports("sse2")) v.push_back(SimdIsa::kSse2);
+    if (__builtin_cpu_supports("avx2")) v.push_back(SimdIsa::kAvx2);
+    if (__builtin_cpu_supports("avx512f")) v.push_back(SimdIsa::kAvx512);
+#endif
+    return v;
+  }();
+  return isas;
+}
+
+SimdIsa SupportedSimdIsa(SimdIsa isa) {
+  SimdIsa supported = SimdIsa::kScalar;
+  for (SimdIsa s : SupportedSimdIsas()) {
+    if (s <= isa) supported = s;
+  }
+  return supported;
+}
+
+}  // namespace cpu_check
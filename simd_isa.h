@@ -0,0 +1,39 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef THIRD_PARTY_CPU_CHECK_SIMD_ISA_H_
+#define THIRD_PARTY_CPU_CHECK_SIMD_ISA_H_
+
+#include <string>
+#include <vector>
+
+namespace cpu_check {
+
+// Vector instruction sets the SIMD hashes have implementations for, in order
+// of width.
+enum class SimdIsa { kScalar, kSse2, kAvx2, kAvx512 };
+
+// Returns "scalar", "sse2", "avx2" or "avx512".
+std::string ToString(SimdIsa isa);
+
+// Returns the instruction sets this CPU supports, narrowest, kScalar, first.
+const std::vector<SimdIsa>& SupportedSimdIsas();
+
+// Returns the widest instruction set this CPU supports that is no wider than
+// 'isa'.
+SimdIsa SupportedSimdIsa(SimdIsa isa);
+
+}  // namespace cpu_check
+#endif  // THIRD_PARTY_CPU_CHECK_SIMD_ISA_H_
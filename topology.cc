@@ -0,0 +1,366 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "topology.h"
+
+#include <dirent.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <thread>
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "utils.h"
+
+namespace cpu_check {
+namespace {
+
+constexpr char kSysCpu[] = "/sys/devices/system/cpu";
+
+// Returns first line of file 'path', or empty string if unreadable.
+std::string ReadLine(const std::string& path) {
+  std::ifstream f(path);
+  std::string line;
+  std::getline(f, line);
+  return line;
+}
+
+// Returns integer content of file 'path', or -1 if unreadable.
+int ReadInt(const std::string& path) {
+  int v;
+  if (!absl::SimpleAtoi(ReadLine(path), &v)) return -1;
+  return v;
+}
+
+// Returns names of entries in directory 'path' starting with 'prefix'.
+std::vector<std::string> ListDir(const std::string& path,
+                                 absl::string_view prefix) {
+  std::vector<std::string> v;
+  DIR* d = opendir(path.c_str());
+  if (d == nullptr) return v;
+  while (const struct dirent* e = readdir(d)) {
+    if (absl::StartsWith(e->d_name, prefix)) v.push_back(e->d_name);
+  }
+  closedir(d);
+  return v;
+}
+
+// Returns the CPUs sharing the highest level unified or data cache of the
+// CPU described in 'cpu_dir'.
+std::vector<int> LastLevelCacheSharers(const std::string& cpu_dir) {
+  const std::string cache_dir = cpu_dir + "/cache";
+  int best_level = -1;
+  std::vector<int> sharers;
+  for (const std::string& index : ListDir(cache_dir, "index")) {
+    const std::string dir = cache_dir + "/" + index;
+    if (ReadLine(dir + "/type") == "Instruction") continue;
+    const int level = ReadInt(dir + "/level");
+    if (level > best_level) {
+      best_level = level;
+      sharers = ParseCpuList(ReadLine(dir + "/shared_cpu_list"));
+    }
+  }
+  return sharers;
+}
+
+#ifdef __linux__
+// Returns the CPUs of the cpuset cgroup containing this process, or empty
+// vector if there is no cpuset, or it is not visible to us.
+std::vector<int> CgroupCpus() {
+  std::ifstream f("/proc/self/cgroup");
+  std::string line;
+  while (std::getline(f, line)) {
+    // "hierarchy-id:controller,...:path", controllers empty for cgroup v2.
+    std::vector<std::string> fields =
+        absl::StrSplit(line, absl::MaxSplits(':', 2));
+    if (fields.size() != 3) continue;
+    const std::string path(absl::StripSuffix(fields[2], "/"));
+    std::string file;
+    if (fields[1].empty()) {
+      file = "/sys/fs/cgroup" + path + "/cpuset.cpus.effective";
+    } else {
+      std::vector<absl::string_view> controllers =
+          absl::StrSplit(fields[1], ',');
+      if (std::find(controllers.begin(), controllers.end(), "cpuset") ==
+          controllers.end()) {
+        continue;
+      }
+      file = "/sys/fs/cgroup/cpuset" + path + "/cpuset.effective_cpus";
+    }
+    std::vector<int> cpus = ParseCpuList(ReadLine(file));
+    if (!cpus.empty()) return cpus;
+  }
+  return {};
+}
+
+// Returns CPUs in both 'a' and 'b', both ascending.
+std::vector<int> Intersect(const std::vector<int>& a,
+                           const std::vector<int>& b) {
+  std::vector<int> v;
+  std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                        std::back_inserter(v));
+  return v;
+}
+#endif
+
+}  // namespace
+
+std::vector<int> PossibleCpus() {
+  return ParseCpuList(ReadLine(absl::StrCat(kSysCpu, "/possible")));
+}
+
+std::vector<int> AllowedCpus() {
+#ifdef __linux__
+  const std::vector<int> possible = PossibleCpus();
+  // The mask must cover all possible CPUs, lest sched_getaffinity fail.
+  const int n = possible.empty() ? CPU_SETSIZE : possible.back() + 1;
+  cpu_set_t* mask = CPU_ALLOC(n);
+  const size_t size = CPU_ALLOC_SIZE(n);
+  std::vector<int> cpus;
+  if (sched_getaffinity(0, size, mask) == 0) {
+    for (int i = 0; i < n; i++) {
+      if (CPU_ISSET_S(i, size, mask)) cpus.push_back(i);
+    }
+  }
+  CPU_FREE(mask);
+  if (cpus.empty()) return cpus;
+
+  const std::vector<int> cgroup = CgroupCpus();
+  if (!cgroup.empty()) cpus = Intersect(cpus, cgroup);
+  const std::vector<int> online =
+      ParseCpuList(ReadLine(absl::StrCat(kSysCpu, "/online")));
+  if (!online.empty()) cpus = Intersect(cpus, online);
+  return cpus;
+#else
+  std::vector<int> cpus(std::thread::hardware_concurrency());
+  for (size_t i = 0; i < cpus.size(); i++) cpus[i] = i;
+  return cpus;
+#endif
+}
+
+std::vector<int> ParseCpuList(absl::string_view s) {
+  std::set<int> cpus;
+  s = absl::StripAsciiWhitespace(s);
+  if (s.empty()) return {};
+  for (absl::string_view range : absl::StrSplit(s, ',')) {
+    std::vector<absl::string_view> ends = absl::StrSplit(range, '-');
+    int lo, hi;
+    if (ends.size() > 2 || !absl::SimpleAtoi(ends[0], &lo)) return {};
+    hi = lo;
+    if (ends.size() == 2 && !absl::SimpleAtoi(ends[1], &hi)) return {};
+    if (lo < 0 || hi < lo) return {};
+    for (int i = lo; i <= hi; i++) cpus.insert(i);
+  }
+  return std::vector<int>(cpus.begin(), cpus.end());
+}
+
+bool ParseCheckerPolicy(absl::string_view s, CheckerPolicy* policy) {
+  for (CheckerPolicy p :
+       {kCheckAnywhere, kCheckSmt, kCheckL3, kCheckRemote, kCheckNode}) {
+    if (s == ToString(p)) {
+      *policy = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string ToString(CheckerPolicy p) {
+  switch (p) {
+    case kCheckAnywhere:
+      return "any";
+    case kCheckSmt:
+      return "smt";
+    case kCheckL3:
+      return "l3";
+    case kCheckRemote:
+      return "remote";
+    case kCheckNode:
+      return "node";
+  }
+  return "unknown";
+}
+
+bool ParseBufferPlacement(absl::string_view s, BufferPlacement* placement) {
+  for (BufferPlacement p : {kPlaceFirstTouch, kPlaceWriter, kPlaceChecker,
+                            kPlaceInterleave, kPlaceRemote}) {
+    if (s == ToString(p)) {
+      *placement = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string ToString(BufferPlacement p) {
+  switch (p) {
+    case kPlaceFirstTouch:
+      return "touch";
+    case kPlaceWriter:
+      return "writer";
+    case kPlaceChecker:
+      return "checker";
+    case kPlaceInterleave:
+      return "interleave";
+    case kPlaceRemote:
+      return "remote";
+  }
+  return "unknown";
+}
+
+CpuTopology CpuTopology::FromSysfs(const std::string& root) {
+  CpuTopology t;
+  for (const std::string& name : ListDir(root, "cpu")) {
+    int id;
+    if (!absl::SimpleAtoi(absl::string_view(name).substr(3), &id)) continue;
+    const std::string dir = root + "/" + name;
+    Cpu c;
+    c.package = ReadInt(dir + "/topology/physical_package_id");
+    c.core = ReadInt(dir + "/topology/core_id");
+    c.smt_siblings =
+        ParseCpuList(ReadLine(dir + "/topology/thread_siblings_list"));
+    if (c.smt_siblings.empty()) {
+      // Offline CPUs have no topology; leave them unknown.
+      continue;
+    }
+    c.l3_sharers = LastLevelCacheSharers(dir);
+    for (const std::string& node : ListDir(dir, "node")) {
+      absl::SimpleAtoi(absl::string_view(node).substr(4), &c.node);
+    }
+    t.cpus_[id] = c;
+  }
+  return t;
+}
+
+const CpuTopology::Cpu* CpuTopology::cpu(int cpu) const {
+  auto it = cpus_.find(cpu);
+  return it == cpus_.end() ? nullptr : &it->second;
+}
+
+std::vector<int> CpuTopology::Cpus() const {
+  std::vector<int> v;
+  for (const auto& [id, c] : cpus_) v.push_back(id);
+  return v;
+}
+
+std::vector<int> CpuTopology::Nodes() const {
+  std::set<int> nodes;
+  for (const auto& [id, c] : cpus_) {
+    if (c.node >= 0) nodes.insert(c.node);
+  }
+  return std::vector<int>(nodes.begin(), nodes.end());
+}
+
+int CpuTopology::Node(int cpu) const {
+  const Cpu* c = this->cpu(cpu);
+  return c == nullptr ? -1 : c->node;
+}
+
+int CpuTopology::CanonicalCore(int cpu) const {
+  const Cpu* c = this->cpu(cpu);
+  return c == nullptr ? cpu : c->smt_siblings.front();
+}
+
+std::string CpuTopology::Summary() const {
+  std::set<int> packages, cores, l3s, nodes;
+  for (const auto& [id, c] : cpus_) {
+    packages.insert(c.package);
+    cores.insert(CanonicalCore(id));
+    if (!c.l3_sharers.empty()) l3s.insert(c.l3_sharers.front());
+    nodes.insert(c.node);
+  }
+  return absl::StrCat(Json("cpus", static_cast<uint64_t>(cpus_.size())), ", ",
+                      Json("packages", static_cast<uint64_t>(packages.size())),
+                      ", ", Json("cores", static_cast<uint64_t>(cores.size())),
+                      ", ", Json("l3s", static_cast<uint64_t>(l3s.size())),
+                      ", ", Json("nodes", static_cast<uint64_t>(nodes.size())));
+}
+
+bool CpuTopology::Satisfies(CheckerPolicy policy, int writer,
+                            int checker) const {
+  if (policy == kCheckAnywhere) return true;
+  const Cpu* w = cpu(writer);
+  const Cpu* c = cpu(checker);
+  if (w == nullptr || c == nullptr) return false;
+  switch (policy) {
+    case kCheckAnywhere:
+      return true;
+    case kCheckSmt:
+      return CanonicalCore(writer) == CanonicalCore(checker);
+    case kCheckL3:
+      return CanonicalCore(writer) != CanonicalCore(checker) &&
+             std::find(w->l3_sharers.begin(), w->l3_sharers.end(), checker) !=
+                 w->l3_sharers.end();
+    case kCheckRemote:
+      return w->package != c->package;
+    case kCheckNode:
+      return w->node >= 0 && c->node >= 0 && w->node != c->node;
+  }
+  return false;
+}
+
+std::vector<int> CpuTopology::PlacementNodes(BufferPlacement placement,
+                                             int writer, int checker,
+                                             bool checker_side) const {
+  const int node = Node(writer);
+  if (node < 0) return {};
+  switch (placement) {
+    case kPlaceFirstTouch:
+      return {};
+    case kPlaceWriter:
+      return {node};
+    case kPlaceChecker: {
+      const int checker_node = checker_side ? Node(checker) : node;
+      if (checker_node < 0) return {};
+      return {checker_node};
+    }
+    case kPlaceInterleave: {
+      std::vector<int> nodes = Nodes();
+      if (nodes.size() < 2) return {};
+      return nodes;
+    }
+    case kPlaceRemote: {
+      // The next node up from the writer's, wrapping around.
+      const std::vector<int> nodes = Nodes();
+      auto it = std::upper_bound(nodes.begin(), nodes.end(), node);
+      const int remote = it == nodes.end() ? nodes.front() : *it;
+      if (remote == node) return {};
+      return {remote};
+    }
+  }
+  return {};
+}
+
+std::vector<int> CpuTopology::OrderCheckers(CheckerPolicy policy, int writer,
+                                            const std::vector<int>& candidates,
+                                            std::knuth_b* rng) const {
+  std::vector<int> v;
+  for (int i : candidates) {
+    if (i != writer) v.push_back(i);
+  }
+  std::shuffle(v.begin(), v.end(), *rng);
+  std::stable_partition(v.begin(), v.end(), [&](int checker) {
+    return Satisfies(policy, writer, checker);
+  });
+  return v;
+}
+
+}  // namespace cpu_check
@@ -0,0 +1,136 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CPU_CHECK_TOPOLOGY_H_
+#define THIRD_PARTY_CPU_CHECK_TOPOLOGY_H_
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace cpu_check {
+
+// Parses a kernel CPU list, eg. "0-3,8,10-11". Returns CPUs in ascending
+// order, or empty vector if malformed.
+std::vector<int> ParseCpuList(absl::string_view s);
+
+// Returns the CPUs the kernel could ever bring online, in ascending order, or
+// empty vector if unknown.
+std::vector<int> PossibleCpus();
+
+// Returns the CPUs, in ascending order, on which the calling thread may now
+// run: its affinity mask, less CPUs excluded by the process's cgroup cpuset
+// or offline. Call from a thread that has not pinned itself to get the
+// process's CPUs. Returns empty vector if the affinity mask is unreadable.
+// Off Linux, returns all CPUs, 0 to hardware_concurrency() - 1.
+std::vector<int> AllowedCpus();
+
+// How to choose the CPUs that check a writer's computation.
+enum CheckerPolicy {
+  kCheckAnywhere,  // Any other CPU.
+  kCheckSmt,       // SMT sibling of the writer.
+  kCheckL3,        // Different core sharing the writer's L3.
+  kCheckRemote,    // Different socket from the writer.
+  kCheckNode,      // Different NUMA node from the writer.
+};
+
+// Parses "any", "smt", "l3", "remote" or "node" into '*policy'. Returns false
+// if unrecognized.
+bool ParseCheckerPolicy(absl::string_view s, CheckerPolicy* policy);
+
+// Returns name of given CheckerPolicy.
+std::string ToString(CheckerPolicy p);
+
+// Where to put the memory of a round's buffers.
+enum BufferPlacement {
+  kPlaceFirstTouch,  // Wherever the kernel first faults it in.
+  kPlaceWriter,      // Writer's NUMA node.
+  kPlaceChecker,     // Checker's node for buffers the checker works on.
+  kPlaceInterleave,  // Interleaved across all nodes.
+  kPlaceRemote,      // A node other than the writer's.
+};
+
+// Parses "touch", "writer", "checker", "interleave" or "remote" into
+// '*placement'. Returns false if unrecognized.
+bool ParseBufferPlacement(absl::string_view s, BufferPlacement* placement);
+
+// Returns name of given BufferPlacement.
+std::string ToString(BufferPlacement p);
+
+// Logical CPU topology, as described by /sys/devices/system/cpu.
+class CpuTopology {
+ public:
+  struct Cpu {
+    int package = -1;               // physical_package_id
+    int core = -1;                  // core_id, unique within package
+    int node = -1;                  // NUMA node
+    std::vector<int> smt_siblings;  // CPUs on same core, including self
+    std::vector<int> l3_sharers;    // CPUs sharing last level cache
+  };
+
+  // Empty topology: all CPUs unknown.
+  CpuTopology() {}
+
+  // Reads topology of all CPUs listed under 'root'.
+  static CpuTopology FromSysfs(
+      const std::string& root = "/sys/devices/system/cpu");
+
+  // Returns description of 'cpu', or nullptr if unknown.
+  const Cpu* cpu(int cpu) const;
+
+  bool empty() const { return cpus_.empty(); }
+
+  // Returns the known CPUs in ascending order.
+  std::vector<int> Cpus() const;
+
+  // Returns the NUMA nodes of known CPUs in ascending order.
+  std::vector<int> Nodes() const;
+
+  // Returns the lowest numbered SMT sibling of 'cpu', which identifies its
+  // core, or 'cpu' if unknown.
+  int CanonicalCore(int cpu) const;
+
+  // Returns JSON fields summarizing the topology.
+  std::string Summary() const;
+
+  // Returns CPUs from 'candidates', excluding 'writer', in random order save
+  // that those satisfying 'policy' with respect to 'writer' come first.
+  // CPUs of unknown topology never satisfy a policy other than
+  // kCheckAnywhere.
+  std::vector<int> OrderCheckers(CheckerPolicy policy, int writer,
+                                 const std::vector<int>& candidates,
+                                 std::knuth_b* rng) const;
+
+  // Returns the NUMA nodes on which to place a buffer of a round written on
+  // 'writer' and checked first on 'checker'. 'checker_side' buffers are
+  // those the checker writes, plus the writer's final copy, which the
+  // checker reads first. Returns empty vector, meaning first touch, if
+  // 'placement' is kPlaceFirstTouch or can't be honored.
+  std::vector<int> PlacementNodes(BufferPlacement placement, int writer,
+                                  int checker, bool checker_side) const;
+
+ private:
+  // Returns NUMA node of 'cpu', or -1 if unknown.
+  int Node(int cpu) const;
+
+  bool Satisfies(CheckerPolicy policy, int writer, int checker) const;
+
+  std::map<int, Cpu> cpus_;
+};
+
+}  // namespace cpu_check
+#endif  // THIRD_PARTY_CPU_CHECK_TOPOLOGY_H_
@@ -0,0 +1,340 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "xxh3.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define X86_TARGET_ATTRIBUTE(s) __attribute__((target(s)))
+#else
+#define X86_TARGET_ATTRIBUTE(s)
+#endif
+
+namespace cpu_check {
+namespace {
+
+using AccumulateFn = Xxh3::AccumulateFn;
+using ScrambleFn = Xxh3::ScrambleFn;
+
+constexpr uint64_t kPrime32_1 = 0x9e3779b1;
+constexpr uint64_t kPrime32_2 = 0x85ebca77;
+constexpr uint64_t kPrime32_3 = 0xc2b2ae3d;
+constexpr uint64_t kPrime64_1 = 0x9e3779b185ebca87;
+constexpr uint64_t kPrime64_2 = 0xc2b2ae3d27d4eb4f;
+constexpr uint64_t kPrime64_3 = 0x165667b19e3779f9;
+constexpr uint64_t kPrime64_4 = 0x85ebca77c2b2ae63;
+constexpr uint64_t kPrime64_5 = 0x27d4eb2f165667c5;
+
+// xxHash's default secret.
+constexpr size_t kSecretSize = 192;
+constexpr uint8_t kSecret[kSecretSize] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+    0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+    0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+    0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+    0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+    0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+    0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+    0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+    0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+// Secret offsets of the last stripe's key, and of the merge's.
+constexpr size_t kLastStripeOffset = kSecretSize - Xxh3::kStripeSize - 7;
+constexpr size_t kMergeOffset = 11;
+
+typedef uint64_t Scalar __attribute__((vector_size(8)));
+typedef uint64_t Lanes2 __attribute__((vector_size(16)));
+typedef uint64_t Lanes4 __attribute__((vector_size(32)));
+typedef uint64_t Lanes8 __attribute__((vector_size(64)));
+
+inline uint32_t Read32(const void* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t Read64(const void* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t Mul128Fold64(uint64_t a, uint64_t b) {
+  const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  return static_cast<uint64_t>(product) ^
+         static_cast<uint64_t>(product >> 64);
+}
+
+inline uint64_t Avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= 0x165667919e3779f9;
+  return h ^ (h >> 32);
+}
+
+inline uint64_t Xxh64Avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= kPrime64_2;
+  h ^= h >> 29;
+  h *= kPrime64_3;
+  return h ^ (h >> 32);
+}
+
+inline uint64_t Rrmxmx(uint64_t h, uint64_t len) {
+  h ^= ((h << 49) | (h >> 15)) ^ ((h << 24) | (h >> 40));
+  h *= 0x9fb21c651e98df25;
+  h ^= (h >> 35) + len;
+  h *= 0x9fb21c651e98df25;
+  return h ^ (h >> 28);
+}
+
+inline uint64_t Mix16(const char* p, const uint8_t* secret) {
+  return Mul128Fold64(Read64(p) ^ Read64(secret),
+                      Read64(p + 8) ^ Read64(secret + 8));
+}
+
+// Hash of inputs of up to 240 bytes, which don't use the accumulators.
+uint64_t HashShort(const char* p, size_t len) {
+  const uint8_t* s = kSecret;
+  if (len == 0) return Xxh64Avalanche(Read64(s + 56) ^ Read64(s + 64));
+  if (len <= 3) {
+    const uint32_t c1 = static_cast<uint8_t>(p[0]);
+    const uint32_t c2 = static_cast<uint8_t>(p[len >> 1]);
+    const uint32_t c3 = static_cast<uint8_t>(p[len - 1]);
+    const uint32_t combined = (c1 << 16) | (c2 << 24) | c3 | (len << 8);
+    return Xxh64Avalanche(combined ^ (Read32(s) ^ Read32(s + 4)));
+  }
+  if (len <= 8) {
+    const uint64_t input =
+        Read32(p + len - 4) + (static_cast<uint64_t>(Read32(p)) << 32);
+    return Rrmxmx(input ^ (Read64(s + 8) ^ Read64(s + 16)), len);
+  }
+  if (len <= 16) {
+    const uint64_t lo = Read64(p) ^ Read64(s + 24) ^ Read64(s + 32);
+    const uint64_t hi = Read64(p + len - 8) ^ Read64(s + 40) ^ Read64(s + 48);
+    return Avalanche(len + __builtin_bswap64(lo) + hi + Mul128Fold64(lo, hi));
+  }
+  uint64_t acc = len * kPrime64_1;
+  if (len <= 128) {
+    if (len > 32) {
+      if (len > 64) {
+        if (len > 96) {
+          acc += Mix16(p + 48, s + 96);
+          acc += Mix16(p + len - 64, s + 112);
+        }
+        acc += Mix16(p + 32, s + 64);
+        acc += Mix16(p + len - 48, s + 80);
+      }
+      acc += Mix16(p + 16, s + 32);
+      acc += Mix16(p + len - 32, s + 48);
+    }
+    acc += Mix16(p, s);
+    acc += Mix16(p + len - 16, s + 16);
+    return Avalanche(acc);
+  }
+  const size_t rounds = len / 16;
+  for (size_t i = 0; i < 8; i++) acc += Mix16(p + 16 * i, s + 16 * i);
+  acc = Avalanche(acc);
+  for (size_t i = 8; i < rounds; i++) {
+    acc += Mix16(p + 16 * i, s + 16 * (i - 8) + 3);
+  }
+  acc += Mix16(p + len - 16, s + 119);
+  return Avalanche(acc);
+}
+
+// The vector helpers below are always inlined, so their vector results never
+// cross a call boundary whose ABI could differ.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// Swaps adjacent lanes of 'v', whose width is at least two.
+template <typename V>
+__attribute__((always_inline)) inline V SwapPairs(const V& v) {
+  constexpr int kWidth = sizeof(V) / sizeof(uint64_t);
+  if constexpr (kWidth == 2) {
+    return __builtin_shuffle(v, Lanes2{1, 0});
+  } else if constexpr (kWidth == 4) {
+    return __builtin_shuffle(v, Lanes4{1, 0, 3, 2});
+  } else {
+    return __builtin_shuffle(v, Lanes8{1, 0, 3, 2, 5, 4, 7, 6});
+  }
+}
+
+// The eight accumulators are held in 'V's, as many as it takes. Inlined into
+// callers compiled for the instruction set 'V' suits.
+template <typename V>
+__attribute__((always_inline)) inline void AccumulateLanes(
+    uint64_t* acc, const char* p, const uint8_t* secret, size_t stripes) {
+  constexpr int kWidth = sizeof(V) / sizeof(uint64_t);
+  constexpr int kVectors = 8 / kWidth;
+  V a[kVectors];
+  memcpy(a, acc, sizeof(a));
+  for (size_t s = 0; s < stripes; s++) {
+    const char* in = p + s * Xxh3::kStripeSize;
+    const uint8_t* key = secret + s * 8;
+    for (int j = 0; j < kVectors; j++) {
+      V data, k, swapped;
+      memcpy(&data, in + j * sizeof(V), sizeof(V));
+      memcpy(&k, key + j * sizeof(V), sizeof(V));
+      const V dk = data ^ k;
+      if constexpr (kWidth == 1) {
+        memcpy(&swapped, in + (j ^ 1) * sizeof(V), sizeof(V));
+      } else {
+        swapped = SwapPairs(data);
+      }
+      a[j] += swapped + (dk & 0xffffffff) * (dk >> 32);
+    }
+  }
+  memcpy(acc, a, sizeof(a));
+}
+
+template <typename V>
+__attribute__((always_inline)) inline void ScrambleLanes(uint64_t* acc) {
+  constexpr int kVectors = 8 * sizeof(uint64_t) / sizeof(V);
+  const uint8_t* key = kSecret + kSecretSize - Xxh3::kStripeSize;
+  for (int j = 0; j < kVectors; j++) {
+    V a, k;
+    memcpy(&a, acc + j * sizeof(V) / sizeof(uint64_t), sizeof(V));
+    memcpy(&k, key + j * sizeof(V), sizeof(V));
+    a = ((a ^ (a >> 47)) ^ k) * kPrime32_1;
+    memcpy(acc + j * sizeof(V) / sizeof(uint64_t), &a, sizeof(V));
+  }
+}
+
+void ScalarAccumulate(uint64_t* acc, const char* p, const uint8_t* secret,
+                      size_t stripes) {
+  AccumulateLanes<Scalar>(acc, p, secret, stripes);
+}
+
+void ScalarScramble(uint64_t* acc) { ScrambleLanes<Scalar>(acc); }
+
+X86_TARGET_ATTRIBUTE("sse2")
+void Sse2Accumulate(uint64_t* acc, const char* p, const uint8_t* secret,
+                    size_t stripes) {
+  AccumulateLanes<Lanes2>(acc, p, secret, stripes);
+}
+
+X86_TARGET_ATTRIBUTE("sse2")
+void Sse2Scramble(uint64_t* acc) { ScrambleLanes<Lanes2>(acc); }
+
+X86_TARGET_ATTRIBUTE("avx2")
+void Avx2Accumulate(uint64_t* acc, const char* p, const uint8_t* secret,
+                    size_t stripes) {
+  AccumulateLanes<Lanes4>(acc, p, secret, stripes);
+}
+
+X86_TARGET_ATTRIBUTE("avx2")
+void Avx2Scramble(uint64_t* acc) { ScrambleLanes<Lanes4>(acc); }
+
+X86_TARGET_ATTRIBUTE("avx512f")
+void Avx512Accumulate(uint64_t* acc, const char* p, const uint8_t* secret,
+                      size_t stripes) {
+  AccumulateLanes<Lanes8>(acc, p, secret, stripes);
+}
+
+X86_TARGET_ATTRIBUTE("avx512f")
+void Avx512Scramble(uint64_t* acc) { ScrambleLanes<Lanes8>(acc); }
+
+struct LanesImpl {
+  AccumulateFn accumulate;
+  ScrambleFn scramble;
+  const char* name;
+};
+
+// Returns the widest implementation no wider than 'isa' that this CPU
+// supports.
+const LanesImpl& Select(SimdIsa isa) {
+  static const LanesImpl impls[] = {
+      {ScalarAccumulate, ScalarScramble, "scalar"},
+      {Sse2Accumulate, Sse2Scramble, "sse2"},
+      {Avx2Accumulate, Avx2Scramble, "avx2"},
+      {Avx512Accumulate, Avx512Scramble, "avx512"},
+  };
+  return impls[static_cast<int>(SupportedSimdIsa(isa))];
+}
+
+}  // namespace
+
+Xxh3::Xxh3(SimdIsa isa)
+    : accumulate_(Select(isa).accumulate),
+      scramble_(Select(isa).scramble),
+      acc_{kPrime32_3, kPrime64_1, kPrime64_2, kPrime64_3,
+           kPrime64_4, kPrime32_2, kPrime64_5, kPrime32_1} {}
+
+void Xxh3::Update(const char* p, size_t n) {
+  total_ += n;
+  auto block = [this](const char* b) {
+    accumulate_(acc_, b, kSecret, kStripesPerBlock);
+    scramble_(acc_);
+    memcpy(last_stripe_, b + kBlockSize - kStripeSize, kStripeSize);
+  };
+  while (n) {
+    // A full buffer is followed by more input, so may now be accumulated.
+    if (buffered_ == kBlockSize) {
+      block(buffer_);
+      buffered_ = 0;
+    }
+    if (buffered_ == 0 && n > kBlockSize) {
+      block(p);
+      p += kBlockSize;
+      n -= kBlockSize;
+      continue;
+    }
+    const size_t k = std::min(n, kBlockSize - buffered_);
+    memcpy(buffer_ + buffered_, p, k);
+    buffered_ += k;
+    p += k;
+    n -= k;
+  }
+}
+
+uint64_t Xxh3::Final() {
+  constexpr size_t kShortMax = 240;
+  if (total_ <= kShortMax) return HashShort(buffer_, total_);
+
+  // The final block holds from one byte to a whole block. Its last stripe
+  // is always the input's last 64 bytes, even if that overlaps the stripes
+  // before it, or reaches back into the previous block.
+  uint64_t acc[8];
+  memcpy(acc, acc_, sizeof(acc));
+  accumulate_(acc, buffer_, kSecret, (buffered_ - 1) / kStripeSize);
+  char last[kStripeSize];
+  if (buffered_ >= kStripeSize) {
+    memcpy(last, buffer_ + buffered_ - kStripeSize, kStripeSize);
+  } else {
+    memcpy(last, last_stripe_ + buffered_, kStripeSize - buffered_);
+    memcpy(last + kStripeSize - buffered_, buffer_, buffered_);
+  }
+  accumulate_(acc, last, kSecret + kLastStripeOffset, 1);
+
+  uint64_t result = total_ * kPrime64_1;
+  for (int i = 0; i < 4; i++) {
+    const uint8_t* s = kSecret + kMergeOffset + 16 * i;
+    result +=
+        Mul128Fold64(acc[2 * i] ^ Read64(s), acc[2 * i + 1] ^ Read64(s + 8));
+  }
+  return Avalanche(result);
+}
+
+std::string Xxh3::Impl(SimdIsa isa) { return Select(isa).name; }
+
+}  // namespace cpu_check
@@ -0,0 +1,76 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_CPU_CHECK_XXH3_H_
+#define THIRD_PARTY_CPU_CHECK_XXH3_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "simd_isa.h"
+
+namespace cpu_check {
+
+// Streaming XXH3 64 bit hash, with seed 0 and the default secret, matching
+// xxHash's XXH3_64bits.
+//
+// Inputs longer than 240 bytes are hashed by eight 64 bit accumulators
+// updated a 64 byte stripe at a time, in AVX-512, AVX2 or SSE2 registers.
+class Xxh3 {
+ public:
+  // Updates the accumulators in the widest registers of 'isa' that the CPU
+  // supports, or one at a time with scalar code.
+  explicit Xxh3(SimdIsa isa);
+
+  Xxh3(const Xxh3&) = delete;
+  Xxh3& operator=(const Xxh3&) = delete;
+
+  void Update(const char* p, size_t n);
+
+  // Returns the hash of everything passed to Update.
+  uint64_t Final();
+
+  // Returns name of the implementation used for 'isa': "avx512", "avx2",
+  // "sse2" or "scalar".
+  static std::string Impl(SimdIsa isa = SimdIsa::kAvx512);
+
+  static constexpr size_t kStripeSize = 64;
+  // Stripes of a block, between which the accumulators are scrambled.
+  static constexpr size_t kStripesPerBlock = 16;
+  static constexpr size_t kBlockSize = kStripesPerBlock * kStripeSize;
+
+  // Accumulates 'stripes' stripes at 'p' into 'acc', from 'secret' on.
+  using AccumulateFn = void (*)(uint64_t* acc, const char* p,
+                                const uint8_t* secret, size_t stripes);
+  // Scrambles 'acc' with the end of the secret.
+  using ScrambleFn = void (*)(uint64_t* acc);
+
+ private:
+  const AccumulateFn accumulate_;
+  const ScrambleFn scramble_;
+  uint64_t acc_[8];
+  uint64_t total_ = 0;  // Bytes passed to Update
+  // Bytes not yet accumulated. A block is accumulated only once more input
+  // follows it, since the final block is treated specially.
+  char buffer_[kBlockSize];
+  size_t buffered_ = 0;
+  // The last stripe of the last block accumulated, which may be needed to
+  // make up the input's final stripe.
+  char last_stripe_[kStripeSize];
+};
+
+}  // namespace cpu_check
+#endif  // THIRD_PARTY_CPU_CHECK_XXH3_H_